@@ -45,7 +45,51 @@ public:
 	 */
 	typedef std::map<User*, insp::aligned_storage<Membership>> MemberMap;
 
+	/** A list of the Memberships of local users on a channel. */
+	typedef std::vector<Membership*> LocalMemberList;
+
+	/** The remote members of a channel which are on a single server. */
+	struct CoreExport ServerMembers final
+	{
+		/** The number of members on the server. */
+		size_t count = 0;
+
+		/** The number of members on the server keyed by their highest prefix rank. Members with no prefix rank are not counted. */
+		insp::flat_map<ModeHandler::Rank, size_t> ranks;
+
+		/** Retrieves the number of members on the server with at least the specified prefix rank.
+		 * @param minrank The minimum prefix rank or 0 to count all members.
+		 */
+		size_t CountAtLeast(ModeHandler::Rank minrank) const;
+	};
+
+	/** A map of the remote members of a channel keyed by the server they are on. */
+	typedef insp::flat_map<Server*, ServerMembers> ServerMemberMap;
+
+	/** A ban mask which has been split at the '@' and compiled for matching against users. */
+	struct CoreExport CompiledBan final
+	{
+		/** The ban mask this was compiled from. */
+		std::string mask;
+
+		/** Whether the ban mask contains an '@'. Masks without one never match a user. */
+		bool valid;
+
+		/** The nick!user part of the ban mask. */
+		CompiledMask nickuser;
+
+		/** The host part of the ban mask. */
+		CompiledMask host;
+
+		/** Compiles a ban mask.
+		 * @param banmask The ban mask to compile.
+		 */
+		CompiledBan(const std::string& banmask);
+	};
+
 private:
+	friend class Membership;
+
 	/** Set default modes for the channel on creation
 	 */
 	void SetDefaultModes();
@@ -56,6 +100,24 @@ private:
 	 */
 	ModeParser::ModeStatus modes;
 
+	/** The memberships of local users on the channel. This is kept separately
+	 * from the user list so that sending to local users does not need to walk
+	 * over every remote member of the channel.
+	 */
+	LocalMemberList localmembers;
+
+	/** The number of remote members of the channel on each server. This allows protocol
+	 * modules to route messages to a channel without walking over every member of it.
+	 */
+	ServerMemberMap servermembers;
+
+	/** Moves a remote member between the prefix rank counts of its server.
+	 * @param members The remote members of the channel on the server of the member.
+	 * @param oldrank The highest prefix rank of the member before the change.
+	 * @param newrank The highest prefix rank of the member after the change.
+	 */
+	static void UpdateServerRank(ServerMembers& members, ModeHandler::Rank oldrank, ModeHandler::Rank newrank);
+
 	/** Remove the given membership from the channel's internal map of
 	 * memberships and destroy the Membership object.
 	 * This function does not remove the channel from User::chanlist.
@@ -174,6 +236,12 @@ public:
 	 */
 	const MemberMap& GetUsers() const { return userlist; }
 
+	/** Retrieves the memberships of the local users on this channel in no particular order. */
+	const LocalMemberList& GetLocalUsers() const { return localmembers; }
+
+	/** Retrieves the number of remote members of this channel on each server. */
+	const ServerMemberMap& GetServerMembers() const { return servermembers; }
+
 	/** Returns true if the user given is on the given channel.
 	 * @param user The user to look for
 	 * @return True if the user is on this channel
@@ -293,6 +361,10 @@ public:
 	 */
 	bool CheckBan(User* user, const std::string& banmask);
 
+	/** Check a single precompiled ban for match
+	 */
+	bool CheckBan(User* user, const CompiledBan& ban);
+
 	/** Write a NOTICE to all local users on the channel
 	 * @param text Text to send
 	 * @param status The minimum status rank to send this message to.
@@ -305,6 +305,20 @@ public:
 private:
 	typedef std::vector<std::pair<SerializedInfo, SerializedMessage>> SerializedList;
 
+	/** Maps the capability profile of a user to the serialized form of the message they receive. */
+	struct ProfileEntry final
+	{
+		/** The serializer used to serialize the message. */
+		const Serializer* serializer;
+
+		/** The capability profile of the users who receive this form (see LocalUser::capprofile). */
+		intptr_t capprofile;
+
+		/** The index of the serialized form of the message in serlist. */
+		size_t serindex;
+	};
+	typedef std::vector<ProfileEntry> ProfileList;
+
 	ParamList params;
 	TagMap tags;
 	std::string command;
@@ -312,6 +326,20 @@ private:
 	mutable SerializedList serlist;
 	bool sideeffect = false;
 
+	/** Cache of serialized forms by capability profile. Only used when all of the tags are capability based. */
+	ProfileList profiles;
+
+	/** The number of tags the message had when profilesafe was last computed. */
+	size_t profiletags = SIZE_MAX;
+
+	/** Whether all of the tags on the message are capability based. */
+	bool profilesafe = false;
+
+	/** Retrieves the index of a serialized form of the message in serlist, serializing it if necessary.
+	 * @param serializeinfo Information about which exact serialized form of the message is the caller asking for.
+	 */
+	size_t GetSerializedIndex(const SerializedInfo& serializeinfo) const;
+
 protected:
 	/** Set command string.
 	 * @param cmd Command string to set.
@@ -461,6 +489,8 @@ public:
 	void InvalidateCache()
 	{
 		serlist.clear();
+		profiles.clear();
+		profiletags = SIZE_MAX;
 	}
 
 	void CopyAll()
@@ -603,6 +633,13 @@ public:
 	 * @return True if the tag should be sent to the user, false otherwise.
 	 */
 	virtual bool ShouldSendTag(LocalUser* user, const MessageTagData& tagdata) = 0;
+
+	/** Determines whether the result of ShouldSendTag() only depends on the client capabilities which the
+	 * user has enabled. If every tag on a message comes from such a provider then the message is serialized
+	 * once per set of enabled capabilities instead of the tag providers being asked about every recipient.
+	 * The default implementation returns false.
+	 */
+	virtual bool IsCapabilityBased() const { return false; }
 };
 
 /** Base class for client protocol event hooks.
@@ -753,7 +790,7 @@ public:
 	 * appear in the output. This is because each user may get a different set of tags for the same message.
 	 * @return Protocol message in wire format. Must contain message delimiter as well, if any (e.g. CRLF for RFC1459).
 	 */
-	virtual std::string Serialize(const Message& msg, const TagSelection& tagwl) const = 0;
+	virtual SerializedMessage Serialize(const Message& msg, const TagSelection& tagwl) const = 0;
 
 	/** Parse a protocol message from wire format.
 	 * @param user Source of the message.
@@ -490,6 +490,15 @@ public:
 	/** The maximum number of local connections that can be made to the IRC server. */
 	size_t SoftLimit;
 
+	/** The number of threads to perform client socket I/O on or 0 to use the main thread. */
+	size_t NetThreads;
+
+	/** Whether to flush socket writes once at the end of each event loop iteration. */
+	bool CoalesceWrites;
+
+	/** Whether to record how long modules spend handling events. */
+	bool ProfileHooks;
+
 	/** Whether to store the full nick!duser\@dhost as a list mode setter instead of just their nick. */
 	bool MaskInList;
 
@@ -248,6 +248,12 @@ public:
 	/** The number of times this command has been executed. */
 	unsigned long use_count = 0;
 
+	/** The total time in nanoseconds spent executing this command including module hooks. */
+	unsigned long long use_time = 0;
+
+	/** The total number of bytes which executing this command has queued to local users. */
+	unsigned long long use_output = 0;
+
 	/** If non-empty then the syntax of the parameter for this command. */
 	std::vector<std::string> syntax;
 
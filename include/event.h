@@ -208,6 +208,7 @@ inline void Events::ModuleEventProvider::Call(void (Class::*function)(FunArgs...
 		if (!mod || mod->dying)
 			continue;
 
+		HookProfiler::Timer timer(mod, this, name, GetModule());
 		Class* klass = static_cast<Class*>(subscriber);
 		(klass->*function)(std::forward<FwdArgs>(args)...);
 	}
@@ -226,6 +227,7 @@ inline ModResult Events::ModuleEventProvider::FirstResult(ModResult (Class::*fun
 		if (!mod || mod->dying)
 			continue;
 
+		HookProfiler::Timer timer(mod, this, name, GetModule());
 		Class* klass = static_cast<Class*>(subscriber);
 		result = (klass->*function)(std::forward<FwdArgs>(args)...);
 		if (result != MOD_RES_PASSTHRU)
@@ -0,0 +1,159 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <chrono>
+
+class Module;
+
+/** Records how much time modules spend handling events.
+ *
+ * When <performance:profilehooks> is enabled every call to a module event
+ * through FOREACH_MOD, FIRST_MOD_RESULT or an Events::ModuleEventProvider
+ * (which includes client protocol event hooks) is timed and accounted to the
+ * module which handled it.
+ */
+class CoreExport HookProfiler final
+{
+public:
+	/** The number of buckets in the call duration histogram. Bucket n counts
+	 * calls which took less than 2^(n+1) nanoseconds.
+	 */
+	static constexpr size_t HistogramSize = 40;
+
+	/** The time spent by a single module handling a single event. */
+	struct Entry final
+	{
+		/** The module which handled the event. */
+		const Module* module;
+
+		/** The module which provides the event or nullptr if it is a core event. */
+		const Module* provider;
+
+		/** The name of the module which handled the event. */
+		std::string modname;
+
+		/** The name of the event. */
+		std::string event;
+
+		/** The number of times the module handled the event. */
+		unsigned long calls = 0;
+
+		/** The total time spent handling the event in nanoseconds. */
+		unsigned long long total = 0;
+
+		/** The longest time spent handling the event in nanoseconds. */
+		unsigned long long max = 0;
+
+		/** The number of calls which fell into each duration bucket. */
+		std::array<unsigned long, HistogramSize> histogram = { };
+
+		/** Estimates a percentile of the call duration.
+		 * @param percentile The percentile to estimate between 0 and 100.
+		 * @return The upper bound of the histogram bucket which contains the percentile in nanoseconds.
+		 */
+		unsigned long long GetPercentile(unsigned int percentile) const;
+	};
+
+	/** Times a single call to a module event. */
+	class Timer final
+	{
+	private:
+		/** The entry to account the call to or nullptr if the profiler is disabled. */
+		Entry* entry = nullptr;
+
+		/** The time at which the call started. */
+		std::chrono::steady_clock::time_point start;
+
+	public:
+		/** Starts timing a call to a module event if the profiler is enabled.
+		 * @param mod The module which is handling the event.
+		 * @param id A pointer which uniquely identifies the event.
+		 * @param name The name of the event.
+		 * @param provider The module which provides the event or nullptr if it is a core event.
+		 */
+		Timer(const Module* mod, const void* id, std::string_view name, const Module* provider = nullptr)
+		{
+			if (HookProfiler::enabled)
+			{
+				entry = &HookProfiler::GetEntry(mod, id, name, provider);
+				start = std::chrono::steady_clock::now();
+			}
+		}
+
+		~Timer()
+		{
+			if (entry)
+				HookProfiler::Record(*entry, std::chrono::steady_clock::now() - start);
+		}
+	};
+
+	/** The key which identifies a profile entry. */
+	typedef std::pair<const Module*, const void*> Key;
+
+	/** Hashes a profile entry key. */
+	struct KeyHash final
+	{
+		size_t operator()(const Key& key) const
+		{
+			return std::hash<const void*>()(key.first) ^ (std::hash<const void*>()(key.second) << 1);
+		}
+	};
+
+	/** A map of profile entries keyed by the module and event they are for. */
+	typedef std::unordered_map<Key, Entry, KeyHash> EntryMap;
+
+private:
+	/** Whether the profiler is enabled. */
+	static bool enabled;
+
+	/** The time at which the profile entries were last reset. */
+	static time_t lastreset;
+
+	/** The profile entries which have been recorded. */
+	static EntryMap entries;
+
+	/** Retrieves the entry for a module and event, creating it if it does not exist. */
+	static Entry& GetEntry(const Module* mod, const void* id, std::string_view name, const Module* provider);
+
+	/** Accounts a call to an entry. */
+	static void Record(Entry& entry, std::chrono::steady_clock::duration duration);
+
+public:
+	/** Enables or disables the profiler. Enabling the profiler when it was disabled resets it.
+	 * @param enable Whether the profiler should be enabled.
+	 */
+	static void SetEnabled(bool enable);
+
+	/** Determines whether the profiler is enabled. */
+	static bool IsEnabled() { return enabled; }
+
+	/** Retrieves the profile entries which have been recorded. */
+	static const EntryMap& GetEntries() { return entries; }
+
+	/** Retrieves the time at which the profile entries were last reset. */
+	static time_t GetLastReset() { return lastreset; }
+
+	/** Resets the counters of all profile entries. */
+	static void Reset();
+
+	/** Removes the profile entries which refer to a module which is being unloaded.
+	 * @param mod The module which is being unloaded.
+	 */
+	static void Forget(const Module* mod);
+};
@@ -58,7 +58,9 @@
 #include <fmt/format.h>
 
 #include "utility/aligned_storage.h"
+#include "utility/histogram.h"
 #include "utility/iterator_range.h"
+#include "utility/shared_buffer.h"
 
 #include "intrusive_list.h"
 #include "flat_map.h"
@@ -79,9 +81,10 @@ CoreExport extern InspIRCd* ServerInstance;
 #include "uid.h"
 #include "server.h"
 #include "token_list.h"
+#include "wildcard.h"
+#include "timer.h"
 #include "users.h"
 #include "channels.h"
-#include "timer.h"
 #include "hashcomp.h"
 #include "channelmanager.h"
 #include "usermanager.h"
@@ -89,7 +92,10 @@ CoreExport extern InspIRCd* ServerInstance;
 #include "command_parse.h"
 #include "mode.h"
 #include "socketengine.h"
+#include "networkthread.h"
 #include "snomasks.h"
+#include "hookprofiler.h"
+#include "mainloopstats.h"
 #include "message.h"
 #include "modules.h"
 #include "moduledefs.h"
@@ -262,6 +268,12 @@ public:
 	/** Manager for state relating to channels. */
 	ChannelManager Channels;
 
+	/** Manager for the threads which perform client socket I/O. */
+	NetworkThreadManager NetThreads;
+
+	/** Statistics about how long each phase of the main loop takes. */
+	MainLoopStats LoopStats;
+
 	/** List of the open ports
 	 */
 	std::vector<ListenSocket*> ports;
@@ -36,12 +36,24 @@ public:
 		std::string setter;
 		std::string mask;
 		time_t time;
+
+		/** The mask compiled as a ban. This is filled in the first time it is needed. */
+		mutable std::optional<Channel::CompiledBan> compiledban;
+
 		ListItem(const std::string& Mask, const std::string& Setter, time_t Time)
 			: setter(Setter)
 			, mask(Mask)
 			, time(Time)
 		{
 		}
+
+		/** Retrieves the mask of this item compiled as a ban. */
+		const Channel::CompiledBan& GetCompiledBan() const
+		{
+			if (!compiledban)
+				compiledban.emplace(mask);
+			return *compiledban;
+		}
 	};
 
 	/** Items stored in the channel's list
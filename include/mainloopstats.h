@@ -0,0 +1,147 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <chrono>
+
+/** Records how long each phase of the main loop takes. All durations are in nanoseconds. */
+class CoreExport MainLoopStats final
+{
+public:
+	/** The phases of a main loop iteration. */
+	enum Phase
+		: uint8_t
+	{
+		/** Ticking timers. */
+		PHASE_TIMERS,
+
+		/** Once a second housekeeping such as the OnBackgroundTimer event. */
+		PHASE_BACKGROUND,
+
+		/** Flushing trial reads and writes before waiting for events. */
+		PHASE_WRITES,
+
+		/** Waiting for socket events. */
+		PHASE_WAIT,
+
+		/** Dispatching socket events. */
+		PHASE_EVENTS,
+
+		/** Flushing writes which were coalesced whilst dispatching socket events. */
+		PHASE_FLUSH,
+
+		/** Deleting objects which were culled. */
+		PHASE_CULLS,
+
+		/** Running deferred actions. */
+		PHASE_ACTIONS,
+
+		/** The number of phases. */
+		PHASE_END
+	};
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	/** The time at which the current iteration started. */
+	Clock::time_point iterstart;
+
+	/** The time at which the current phase started. */
+	Clock::time_point phasestart;
+
+	/** The time spent waiting for events in the current iteration. */
+	Clock::duration waited = Clock::duration::zero();
+
+	/** The duration of each phase. */
+	std::array<insp::histogram, PHASE_END> phases;
+
+	/** The duration of each iteration. */
+	insp::histogram iterations;
+
+	/** The duration of each iteration excluding the time spent waiting for events. */
+	insp::histogram busy;
+
+	/** The time at which the statistics were last reset. */
+	time_t lastreset = 0;
+
+	static uint64_t ToNanoseconds(Clock::duration duration)
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+	}
+
+public:
+	/** Marks the start of a main loop iteration and records the duration of the previous one. */
+	void BeginIteration()
+	{
+		const Clock::time_point now = Clock::now();
+		if (iterstart != Clock::time_point())
+		{
+			iterations.record(ToNanoseconds(now - iterstart));
+			busy.record(ToNanoseconds(now - iterstart - waited));
+		}
+		iterstart = phasestart = now;
+		waited = Clock::duration::zero();
+	}
+
+	/** Marks the end of a main loop phase and records its duration.
+	 * @param phase The phase which has ended.
+	 */
+	void EndPhase(Phase phase)
+	{
+		const Clock::time_point now = Clock::now();
+		const Clock::duration duration = now - phasestart;
+		if (phase == PHASE_WAIT)
+			waited += duration;
+
+		phases[phase].record(ToNanoseconds(duration));
+		phasestart = now;
+	}
+
+	/** Retrieves the durations of a main loop phase. */
+	const insp::histogram& GetPhase(Phase phase) const { return phases[phase]; }
+
+	/** Retrieves the durations of main loop iterations. */
+	const insp::histogram& GetIterations() const { return iterations; }
+
+	/** Retrieves the durations of main loop iterations excluding the time spent waiting for events. */
+	const insp::histogram& GetBusy() const { return busy; }
+
+	/** Retrieves the time at which the statistics were last reset. */
+	time_t GetLastReset() const { return lastreset; }
+
+	/** Retrieves the name of a main loop phase. */
+	static const char* GetPhaseName(Phase phase)
+	{
+		static const char* names[PHASE_END] = {
+			"timers", "background", "writes", "wait", "events", "flush", "culls", "actions"
+		};
+		return names[phase];
+	}
+
+	/** Forgets all recorded durations.
+	 * @param now The current time.
+	 */
+	void Reset(time_t now)
+	{
+		for (auto& phase : phases)
+			phase.reset();
+		iterations.reset();
+		busy.reset();
+		lastreset = now;
+	}
+};
@@ -35,6 +35,12 @@ class CoreExport Membership final
 	: public Extensible
 	, public insp::intrusive_list_node<Membership>
 {
+private:
+	friend class Channel;
+
+	/** The index of this membership in the local member list of the channel or SIZE_MAX if the user is not local. */
+	size_t localindex = SIZE_MAX;
+
 public:
 	/** Type of the Membership id
 	 */
@@ -1196,7 +1196,10 @@ public:
 			try \
 			{ \
 				if (!_mod->dying) \
+				{ \
+					HookProfiler::Timer _timer(_mod, &_handlers, #EVENT); \
 					_mod->EVENT ARGS; \
+				} \
 			} \
 			catch (const CoreException& _exception_ ## EVENT) \
 			{ \
@@ -1221,6 +1224,7 @@ public:
 			{ \
 				if (_mod->dying) \
 					continue; \
+				HookProfiler::Timer _timer(_mod, &_handlers, #EVENT); \
 				RESULT = _mod->EVENT ARGS; \
 				if (RESULT != MOD_RES_PASSTHRU) \
 					break; \
@@ -33,9 +33,22 @@ namespace Cap
 	{
 	public:
 		ExtItem(Module* mod);
+		void Delete(Extensible* container, void* item) override;
 		void FromInternal(Extensible* container, const std::string& value) noexcept override;
 		std::string ToHuman(const Extensible* container, void* item) const noexcept override;
 		std::string ToInternal(const Extensible* container, void* item) const noexcept override;
+
+		/** Sets the capabilities a user has enabled and updates their capability profile.
+		 * @param user The user to set the capabilities of.
+		 * @param caps The new capabilities of the user.
+		 */
+		void SetCaps(User* user, Ext caps)
+		{
+			Set(user, caps);
+			LocalUser* const luser = IS_LOCAL(user);
+			if (luser)
+				luser->capprofile = caps;
+		}
 	};
 
 	class Capability;
@@ -210,7 +223,7 @@ namespace Cap
 			if (!IsRegistered())
 				return;
 			Ext curr = extitem->Get(user);
-			extitem->Set(user, (val ? AddToMask(curr) : DelFromMask(curr)));
+			extitem->SetCaps(user, (val ? AddToMask(curr) : DelFromMask(curr)));
 		}
 
 		/** Activate or deactivate the capability.
@@ -0,0 +1,112 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "iohook.h"
+
+/** I/O hook provider for compression modules. */
+class CompressIOHookProvider
+	: public IOHookProvider
+{
+public:
+	CompressIOHookProvider(Module* mod, const std::string& Name)
+		: IOHookProvider(mod, "compress/" + Name, IOH_COMPRESS, true)
+	{
+	}
+};
+
+/** An I/O hook which compresses the data sent over a socket.
+ *
+ * Compression is usually negotiated after a connection has been established
+ * so a compression hook is always inserted at the start of the hook chain of
+ * a socket. Data which was queued before the hook was added is sent as-is and
+ * everything written afterwards is compressed. Received data is passed through
+ * as-is until StartDecompressing() is called.
+ */
+class CompressIOHook
+	: public IOHookMiddle
+{
+public:
+	/** Statistics about the data which has passed through a compression hook. */
+	struct Stats final
+	{
+		/** The number of bytes which have been compressed. */
+		uint64_t raw_out = 0;
+
+		/** The number of bytes which were sent after compression. */
+		uint64_t compressed_out = 0;
+
+		/** The number of bytes which were received before decompression. */
+		uint64_t compressed_in = 0;
+
+		/** The number of bytes which have been decompressed. */
+		uint64_t raw_in = 0;
+
+		/** The time spent compressing and decompressing data. */
+		std::chrono::steady_clock::duration time = std::chrono::steady_clock::duration::zero();
+	};
+
+protected:
+	/** Statistics about the data which has passed through this hook. */
+	Stats stats;
+
+	/** Inserts this hook at the start of the hook chain of a socket.
+	 * @param sock The socket to hook.
+	 */
+	void Insert(StreamSocket* sock)
+	{
+		IOHook* const oldhook = sock->GetIOHook();
+		sock->DelIOHook();
+		sock->AddIOHook(this);
+		SetNextHook(oldhook);
+
+		// Anything which was queued before now has not been compressed.
+		GetSendQ().moveall(sock->GetSendQ());
+	}
+
+public:
+	/** Retrieves the compression hook of a socket.
+	 * @param sock The socket to check.
+	 * @return The compression hook of the socket or nullptr if it does not have one.
+	 */
+	static CompressIOHook* IsCompressed(StreamSocket* sock)
+	{
+		IOHook* const firsthook = sock->GetIOHook();
+		if (firsthook && (firsthook->prov->type == IOHookProvider::IOH_COMPRESS))
+			return static_cast<CompressIOHook*>(firsthook);
+
+		return nullptr;
+	}
+
+	CompressIOHook(const std::shared_ptr<IOHookProvider>& hookprov)
+		: IOHookMiddle(hookprov)
+	{
+	}
+
+	/** Retrieves statistics about the data which has passed through this hook. */
+	const Stats& GetStats() const { return stats; }
+
+	/** Starts decompressing the data received from the socket.
+	 * @param sock The socket this hook is attached to.
+	 * @param data Data which was received after the remote end started compressing but
+	 *             which has already been passed up the hook chain. On success this is
+	 *             replaced with the decompressed data.
+	 * @return True if the data was decompressed successfully; otherwise, false.
+	 */
+	virtual bool StartDecompressing(StreamSocket* sock, std::string& data) = 0;
+};
@@ -186,4 +186,10 @@ public:
 	{
 		return ctctagcap.IsEnabled(user);
 	}
+
+	/** @copydoc ClientProtocol::MessageTagProvider::IsCapabilityBased */
+	bool IsCapabilityBased() const override
+	{
+		return true;
+	}
 };
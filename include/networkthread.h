@@ -0,0 +1,79 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+class NetworkThread;
+class StreamSocket;
+
+/** Moves the socket I/O of client connections onto a pool of network threads.
+ *
+ * When <performance:netthreads> is set each plaintext client socket is handed
+ * to one of the threads once the connection has been accepted. The thread
+ * receives data, frames it into lines and flushes the send queue. Everything
+ * else, including parsing and dispatching the received lines, stays on the
+ * main thread.
+ */
+class CoreExport NetworkThreadManager final
+{
+private:
+	/** The threads which perform network I/O. */
+	std::vector<NetworkThread*> threads;
+
+	/** The thread which the next socket will be attached to. */
+	size_t nextthread = 0;
+
+	/** Whether the threads have been started. */
+	bool started = false;
+
+	/** Starts the network threads if they are enabled and not yet running.
+	 * @return True if there are network threads available; otherwise, false.
+	 */
+	bool Start();
+
+public:
+	/** Hands the I/O of a socket to a network thread.
+	 * @param sock The socket to attach. It must not have an I/O hook.
+	 * @return True if the socket was attached; otherwise, false.
+	 */
+	bool Attach(StreamSocket* sock) ATTR_NOT_NULL(2);
+
+	/** Takes the I/O of a socket back from its network thread. Any data which
+	 * was not sent by the thread is moved back to the send queue of the socket
+	 * and any data which was received by the thread is moved to the receive
+	 * queue of the socket.
+	 * @param sock The socket to detach.
+	 * @param resume Whether the socket engine should start handling the socket.
+	 */
+	void Detach(StreamSocket* sock, bool resume) ATTR_NOT_NULL(2);
+
+	/** Passes the send queue of an attached socket to its network thread.
+	 * @param sock The socket to write to.
+	 */
+	void Write(StreamSocket* sock) ATTR_NOT_NULL(2);
+
+	/** Retrieves the number of bytes which are waiting to be sent by the network thread of a socket.
+	 * @param sock The socket to check.
+	 */
+	size_t GetSendQSize(const StreamSocket* sock) const ATTR_NOT_NULL(2);
+
+	/** Retrieves the number of running network threads. */
+	size_t GetThreadCount() const { return threads.size(); }
+
+	/** Stops the network threads. All sockets must have been detached first. */
+	void Stop();
+};
@@ -252,9 +252,24 @@ public:
 		unsigned long ReadEvents = 0;
 		unsigned long WriteEvents = 0;
 		unsigned long ErrorEvents = 0;
+
+		/** The number of event mask changes which did not need a system call because they
+		 * were batched with other changes to the same socket.
+		 */
+		unsigned long ElidedChanges = 0;
+
+		/** The number of events which were returned each time the socket engine woke up. */
+		insp::histogram EventsPerWakeup;
+
+		/** Records that the socket engine has finished waiting for events.
+		 * @param events The number of events which were returned.
+		 */
+		void OnWakeup(int events);
 	};
 
 private:
+	friend class NetworkThread; // stats
+
 	/** Reference table, contains all current handlers
 	 **/
 	static std::vector<EventHandler*> ref;
@@ -269,6 +284,9 @@ private:
 	 */
 	static std::set<int> trials;
 
+	/** Whether write events are being deferred until the end of the current dispatch pass. */
+	static bool deferwrites;
+
 	/** Socket engine statistics: count of various events, bandwidth usage
 	 */
 	static Statistics stats;
@@ -390,6 +408,17 @@ public:
 	 */
 	static void DispatchTrialWrites();
 
+	/** Dispatches pending trial reads and writes, waits for events and dispatches them.
+	 * @param coalesce If true then writes which become possible while events are being
+	 * dispatched are deferred and every socket with pending output is flushed once after
+	 * all events have been dispatched.
+	 * @return The number of events which have occurred.
+	 */
+	static int Dispatch(bool coalesce);
+
+	/** Determines whether write events are currently being deferred by Dispatch. */
+	static bool IsDeferringWrites() { return deferwrites; }
+
 	/** Abstraction for BSD sockets accept(2).
 	 * This function should emulate its namesake system call exactly.
 	 * @param eh This version of the call takes an EventHandler instead of a bare file descriptor.
@@ -75,6 +75,7 @@ enum BufferedSocketError
 
 /* Required forward declarations */
 class BufferedSocket;
+struct NetworkLink;
 
 /** Used to time out socket connections
  */
@@ -121,9 +122,10 @@ public:
 	class SendQueue final
 	{
 	public:
-		/** One element of the queue, a continuous buffer
+		/** One element of the queue, a continuous buffer which may be shared with the send
+		 * queues of other sockets.
 		 */
-		typedef std::string Element;
+		typedef insp::shared_buffer Element;
 
 		/** Sequence container of buffers in the queue
 		 */
@@ -176,10 +178,10 @@ public:
 		/** Remove bytes from the beginning of the first buffer
 		 * @param n Number of bytes to remove
 		 */
-		void erase_front(Element::size_type n)
+		void erase_front(size_t n)
 		{
 			nbytes -= n;
-			data.front().erase(0, n);
+			data.front().erase_front(n);
 		}
 
 		/** Insert a new buffer at the beginning of the queue
@@ -200,6 +202,15 @@ public:
 			nbytes += newdata.length();
 		}
 
+		/** Insert a new buffer at the end of the queue
+		 * @param newdata Data to add
+		 */
+		void push_back(Element&& newdata)
+		{
+			nbytes += newdata.length();
+			data.push_back(std::move(newdata));
+		}
+
 		/** Clear the queue
 		 */
 		void clear()
@@ -216,7 +227,7 @@ public:
 		}
 
 	private:
-		/** Private send queue. Note that individual strings may be shared.
+		/** Private send queue. Note that individual buffers may be shared with other queues.
 		 */
 		Container data;
 
@@ -233,6 +244,9 @@ public:
 	};
 
 private:
+	friend class NetworkThread;
+	friend class NetworkThreadManager;
+
 	/** Whether this socket should close once its sendq is empty */
 	bool closeonempty = false;
 
@@ -249,6 +263,9 @@ private:
 	/** Error - if nonempty, the socket is dead, and this is the reason. */
 	std::string error;
 
+	/** If non-null then the network thread which is performing I/O for this socket. */
+	std::shared_ptr<NetworkLink> netlink;
+
 	/** Check if the socket has an error set, if yes, call OnError
 	 * @param err Error to pass to OnError()
 	 */
@@ -334,7 +351,7 @@ public:
 
 	/** Send the given data out the socket, either now or when writes unblock
 	 */
-	void WriteData(const std::string& data);
+	void WriteData(const SendQueue::Element& data);
 
 	/** Retrieves the current size of the send queue. */
 	size_t GetSendQSize() const;
@@ -28,30 +28,42 @@
 
 class Module;
 
-/** Timer class for one-second resolution timers
+/** Timer class for one-second (or optionally millisecond) resolution timers
  * Timer provides a facility which allows module
  * developers to create one-shot timers. The timer
  * can be made to trigger at any time up to a one-second
- * resolution. To use Timer, inherit a class from
+ * resolution or, by using SetIntervalMillis(), up to a
+ * one-millisecond resolution. To use Timer, inherit a class from
  * Timer, then insert your inherited class into the
  * queue using Server::AddTimer(). The Tick() method of
  * your object (which you have to override) will be called
  * at the given time.
  */
 class CoreExport Timer
+	: public insp::intrusive_list_node<Timer>
 {
+	friend class TimerManager;
+
 	/** The triggering time
 	 */
 	time_t trigger = 0;
 
-	/** Number of seconds between triggers
+	/** The triggering time in milliseconds since the epoch.
+	 */
+	uint64_t expiry = 0;
+
+	/** Number of milliseconds between triggers
 	 */
-	unsigned long secs;
+	uint64_t msecs;
 
 	/** True if this is a repeating timer
 	 */
 	bool repeat;
 
+	/** The timer wheel slot this timer is currently in or nullptr if it is not active.
+	 */
+	insp::intrusive_list_tail<Timer>* slot = nullptr;
+
 public:
 	/** Default constructor, initializes the triggering time
 	 * @param secs_from_now The number of seconds from now to trigger the timer
@@ -69,6 +81,14 @@ public:
 		return trigger;
 	}
 
+	/** Retrieves the time in milliseconds since the epoch at which this timer will tick next. If
+	 * the timer is not active then 0 will be returned.
+	 */
+	uint64_t GetTriggerMillis() const
+	{
+		return slot ? expiry : 0;
+	}
+
 	/** Sets the trigger timeout to a new value
 	 * This does not update the bookkeeping in TimerManager, use SetInterval()
 	 * to change the interval between ticks while keeping TimerManager updated
@@ -82,6 +102,10 @@ public:
 	 */
 	void SetInterval(unsigned long interval, bool restart = true);
 
+	/** Sets the interval between two ticks in milliseconds.
+	 */
+	void SetIntervalMillis(uint64_t interval, bool restart = true);
+
 	/** Called when the timer ticks.
 	 * You should override this method with some useful code to
 	 * handle the tick event.
@@ -101,7 +125,15 @@ public:
 	 */
 	unsigned long GetInterval() const
 	{
-		return secs;
+		return static_cast<unsigned long>(msecs / 1000);
+	}
+
+	/** Returns the interval (number of milliseconds between ticks)
+	 * of this timer object.
+	 */
+	uint64_t GetIntervalMillis() const
+	{
+		return msecs;
 	}
 
 	/** Cancels the repeat state of a repeating timer.
@@ -117,16 +149,69 @@ public:
 /** This class manages sets of Timers, and triggers them at their defined times.
  * This will ensure timers are not missed, as well as removing timers that have
  * expired and allowing the addition of new ones.
+ *
+ * Timers are stored in a hierarchical timing wheel with a resolution of one
+ * millisecond. The first level has a slot for each of the next 256 milliseconds
+ * and each further level has 64 slots which each cover a whole turn of the level
+ * below it. Adding and removing a timer is O(1) and timers are moved down to the
+ * lower levels as their trigger time approaches.
  */
 class CoreExport TimerManager final
 {
-	typedef std::multimap<time_t, Timer*> TimerMap;
+	typedef insp::intrusive_list_tail<Timer> TimerList;
 
-	/** A list of all pending timers
+	/** The number of bits of the trigger time which are used to index the first level. */
+	static constexpr unsigned int ROOT_BITS = 8;
+
+	/** The number of bits of the trigger time which are used to index the other levels. */
+	static constexpr unsigned int LEVEL_BITS = 6;
+
+	/** The number of levels above the first level. */
+	static constexpr unsigned int LEVELS = 4;
+
+	/** The number of slots in the first level. */
+	static constexpr uint64_t ROOT_SIZE = UINT64_C(1) << ROOT_BITS;
+
+	/** The mask for the first level slot index. */
+	static constexpr uint64_t ROOT_MASK = ROOT_SIZE - 1;
+
+	/** The number of slots in each of the other levels. */
+	static constexpr uint64_t LEVEL_SIZE = UINT64_C(1) << LEVEL_BITS;
+
+	/** The mask for the slot index of the other levels. */
+	static constexpr uint64_t LEVEL_MASK = LEVEL_SIZE - 1;
+
+	/** The number of milliseconds that can be covered by the timer wheel. */
+	static constexpr uint64_t MAX_DELTA = UINT64_C(1) << (ROOT_BITS + LEVEL_BITS * LEVELS);
+
+	/** The slots of the timer wheel. The first ROOT_SIZE entries are the first level and each
+	 * following group of LEVEL_SIZE entries is one of the higher levels.
 	 */
-	TimerMap Timers;
+	std::array<TimerList, ROOT_SIZE + LEVEL_SIZE * LEVELS> slots;
+
+	/** The time in milliseconds up to which timers have been ticked. */
+	uint64_t current = 0;
+
+	/** The number of active timers. */
+	size_t count = 0;
+
+	/** Inserts a timer into the slot for its trigger time.
+	 * @param t The timer to insert.
+	 * @param cascading Whether the timer is being moved down during a tick. If so then timers
+	 *                  which are due in the tick being processed are put in its slot.
+	 */
+	void Schedule(Timer* t, bool cascading = false);
+
+	/** Moves the timers in a slot of one of the higher levels into the lower levels. */
+	void Cascade(unsigned int level, uint64_t tick);
+
+	/** Reinserts every timer relative to a new current time. Used when the clock jumps. */
+	void Rebuild(uint64_t now);
 
 public:
+	/** Retrieves the current time in milliseconds since the epoch. */
+	static uint64_t Now();
+
 	/** Tick all pending Timers
 	 */
 	void TickTimers();
@@ -140,4 +225,10 @@ public:
 	 * @param T an Timer derived class to remove
 	 */
 	void DelTimer(Timer* T);
+
+	/** Retrieves the number of milliseconds the main loop can wait for socket events before a
+	 * timer needs to be ticked.
+	 * @param maxwait The maximum number of milliseconds to wait for.
+	 */
+	int GetWaitTime(int maxwait) const;
 };
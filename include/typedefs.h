@@ -54,7 +54,7 @@ namespace ClientProtocol
 
 	typedef std::vector<Message*> MessageList;
 	typedef std::vector<std::string> ParamList;
-	typedef std::string SerializedMessage;
+	typedef insp::shared_buffer SerializedMessage;
 
 	struct CoreExport MessageTagData final
 	{
@@ -98,10 +98,13 @@ public:
 	/** Number of local unknown (not fully connected) users. */
 	size_t unknown_count = 0;
 
-	/** Perform background user events for all local users such as PING checks, connection timeouts,
-	 * penalty management and recvq processing for users who have data in their recvq due to throttling.
+	/** Perform background user events for a local user such as PING checks, connection timeouts,
+	 * and recvq processing for users who have data in their recvq due to throttling.
+	 * This is called when the deadline set with LocalUser::ScheduleHousekeeping is reached and
+	 * schedules the next one.
+	 * @param user The user to perform background events for.
 	 */
-	void DoBackgroundUserStuff();
+	void DoBackgroundUserStuff(LocalUser* user) ATTR_NOT_NULL(2);
 
 	/** Handle a client connection.
 	 * Creates a new LocalUser object, inserts it into the appropriate containers,
@@ -59,6 +59,9 @@ public:
 	/** The hosts that this user can connect from. */
 	std::vector<std::string> hosts;
 
+	/** The hosts that this user can connect from compiled for matching. */
+	std::vector<CompiledMask> compiledhosts;
+
 	/** The name of this connect class. */
 	std::string name;
 
@@ -139,6 +142,9 @@ public:
 
 	/** Retrieves the hosts for this connect class. */
 	const std::vector<std::string>& GetHosts() const { return hosts; }
+
+	/** Retrieves the hosts for this connect class compiled for matching. */
+	const std::vector<CompiledMask>& GetCompiledHosts() const { return compiledhosts; }
 };
 
 class CoreExport AwayState final
@@ -757,6 +763,10 @@ class CoreExport UserIOHandler final
 {
 private:
 	size_t checked_until = 0;
+
+	/** The time in milliseconds at which the penalty of the user was last reduced. */
+	uint64_t lastdecay = 0;
+
 public:
 	LocalUser* const user;
 	UserIOHandler(LocalUser* me)
@@ -765,6 +775,12 @@ public:
 	{
 	}
 	void OnDataReady() override;
+
+	/** Determines whether the user has sent data which has not been processed yet because they
+	 * were throttled.
+	 */
+	bool HasPendingData() const { return checked_until < recvq.length(); }
+
 	bool OnChangeLocalSocketAddress(const irc::sockets::sockaddrs& sa) override;
 	bool OnChangeRemoteSocketAddress(const irc::sockets::sockaddrs& sa) override;
 	void OnError(BufferedSocketError error) override;
@@ -774,7 +790,7 @@ public:
 	 * sendq value, the user will be removed, and further buffer adds will be dropped.
 	 * @param data The data to add to the write buffer
 	 */
-	void AddWriteBuf(const std::string& data);
+	void AddWriteBuf(const SendQueue::Element& data);
 };
 
 class CoreExport LocalUser final
@@ -782,9 +798,31 @@ class CoreExport LocalUser final
 	, public insp::intrusive_list_node<LocalUser>
 {
 private:
+	/** Timer which runs the background checks for a local user when they are next due. */
+	class HousekeepingTimer final
+		: public Timer
+	{
+	private:
+		/** The user to run the background checks for. */
+		LocalUser* const user;
+
+	public:
+		HousekeepingTimer(LocalUser* u)
+			: Timer(0, false)
+			, user(u)
+		{
+		}
+
+		/** @copydoc Timer::Tick */
+		bool Tick() override;
+	};
+
 	/** The connect class this user is in. */
 	std::shared_ptr<ConnectClass> connectclass;
 
+	/** Runs the background checks for this user when they are next due. */
+	HousekeepingTimer housekeeping;
+
 	/** Message list, can be passed to the two parameter Send(). */
 	static ClientProtocol::MessageList sendmsglist;
 
@@ -870,6 +908,12 @@ public:
 
 	uint64_t already_sent = 0;
 
+	/** Identifies the set of client capabilities this user has enabled. Users
+	 * with the same value receive the same tags from capability based message
+	 * tag providers. This is maintained by the cap module.
+	 */
+	intptr_t capprofile = 0;
+
 	/** Check if the user matches a G- or K-line, and disconnect them if they do.
 	 * @param doZline True if Z-lines should be checked (if IP has changed since initial connect)
 	 * Returns true if the user matched a ban, false else.
@@ -897,6 +941,18 @@ public:
 	 */
 	bool FindConnectClass(bool keepexisting = false);
 
+	/** Ensures that the background checks for this user (PING checks, connection timeouts,
+	 * processing throttled lines, etc) run no later than the specified time. If they are already
+	 * scheduled to run before then this does nothing.
+	 * @param when The time at which the background checks need to run.
+	 */
+	void ScheduleHousekeeping(time_t when) { ScheduleHousekeepingMillis(static_cast<uint64_t>(when) * 1000); }
+
+	/** Ensures that the background checks for this user run no later than the specified time.
+	 * @param when The time in milliseconds since the epoch at which the background checks need to run.
+	 */
+	void ScheduleHousekeepingMillis(uint64_t when);
+
 	/** Send a NOTICE message from the local server to the user.
 	 * The message will be sent even if the user is connected to a remote server.
 	 * @param text Text to send
@@ -0,0 +1,121 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <bit>
+
+namespace insp
+{
+	class histogram;
+}
+
+/** Records the distribution of a non-negative value with a bounded relative error.
+ *
+ * Values are counted in buckets which are linear within each power of two
+ * (like an HDR histogram) so that every recorded value is accounted to a
+ * bucket whose bounds are within 1/SubBuckets of it whilst still covering
+ * the entire range of a 64-bit integer.
+ */
+class insp::histogram final
+{
+public:
+	/** The number of bits of precision which are kept for each value. */
+	static constexpr unsigned int SubBucketBits = 4;
+
+	/** The number of buckets each power of two is split into. */
+	static constexpr uint64_t SubBuckets = 1 << SubBucketBits;
+
+	/** The total number of buckets. */
+	static constexpr size_t Buckets = SubBuckets * (65 - SubBucketBits);
+
+private:
+	/** The number of values in each bucket. */
+	std::array<uint64_t, Buckets> counts = { };
+
+	/** The number of values which have been recorded. */
+	uint64_t total = 0;
+
+	/** The largest value which has been recorded. */
+	uint64_t largest = 0;
+
+	/** Retrieves the bucket which a value should be counted in. */
+	static size_t bucket_for(uint64_t value)
+	{
+		if (value < SubBuckets)
+			return value;
+
+		const unsigned int shift = std::bit_width(value) - 1 - SubBucketBits;
+		return (shift + 1) * SubBuckets + ((value >> shift) & (SubBuckets - 1));
+	}
+
+	/** Retrieves the largest value which is counted in a bucket. */
+	static uint64_t bucket_upper(size_t bucket)
+	{
+		if (bucket < SubBuckets)
+			return bucket;
+
+		const size_t shift = (bucket / SubBuckets) - 1;
+		const uint64_t lower = (SubBuckets + (bucket % SubBuckets)) << shift;
+		return lower + ((uint64_t(1) << shift) - 1);
+	}
+
+public:
+	/** Records a value.
+	 * @param value The value to record.
+	 */
+	void record(uint64_t value)
+	{
+		counts[bucket_for(value)]++;
+		total++;
+		largest = std::max(largest, value);
+	}
+
+	/** Retrieves the number of values which have been recorded. */
+	uint64_t count() const { return total; }
+
+	/** Retrieves the largest value which has been recorded. */
+	uint64_t max() const { return largest; }
+
+	/** Estimates a percentile of the recorded values.
+	 * @param pct The percentile to estimate between 0 and 100.
+	 * @return The upper bound of the bucket containing the percentile or 0 if no values have been recorded.
+	 */
+	uint64_t percentile(double pct) const
+	{
+		if (!total)
+			return 0;
+
+		const auto wanted = std::max<uint64_t>(1, static_cast<uint64_t>(total * pct / 100.0 + 0.5));
+		uint64_t seen = 0;
+		for (size_t bucket = 0; bucket < Buckets; ++bucket)
+		{
+			seen += counts[bucket];
+			if (seen >= wanted)
+				return std::min(bucket_upper(bucket), largest);
+		}
+		return largest;
+	}
+
+	/** Forgets all values which have been recorded. */
+	void reset()
+	{
+		counts.fill(0);
+		total = 0;
+		largest = 0;
+	}
+};
@@ -0,0 +1,107 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+namespace insp
+{
+	class shared_buffer;
+}
+
+/** An immutable reference counted byte buffer. Copying a shared buffer only copies a pointer to
+ * the underlying bytes which allows the same data to be queued for many sockets at once. Each
+ * copy keeps its own view of the buffer so consuming bytes from one copy does not affect others.
+ */
+class insp::shared_buffer final
+{
+private:
+	/** The underlying bytes or nullptr if the buffer is empty. */
+	std::shared_ptr<const std::string> buffer;
+
+	/** The position within the underlying bytes that this view starts at. */
+	size_t offset = 0;
+
+public:
+	/** Initialises a new empty shared buffer. */
+	shared_buffer() = default;
+
+	/** Initialises a new shared buffer by taking ownership of a string.
+	 * @param str The string to take ownership of.
+	 */
+	shared_buffer(std::string str)
+		: buffer(str.empty() ? nullptr : std::make_shared<const std::string>(std::move(str)))
+	{
+	}
+
+	/** Initialises a new shared buffer from a null terminated string.
+	 * @param str The string to copy into the buffer.
+	 */
+	shared_buffer(const char* str)
+		: shared_buffer(std::string(str))
+	{
+	}
+
+	/** Initialises a new shared buffer from a sized byte array.
+	 * @param str The bytes to copy into the buffer.
+	 * @param len The number of bytes to copy.
+	 */
+	shared_buffer(const char* str, size_t len)
+		: shared_buffer(std::string(str, len))
+	{
+	}
+
+	/** Retrieves a pointer to the first unconsumed byte in the buffer. */
+	const char* data() const { return buffer ? buffer->data() + offset : ""; }
+
+	/** Retrieves the number of unconsumed bytes in the buffer. */
+	size_t length() const { return buffer ? buffer->length() - offset : 0; }
+
+	/** Retrieves the number of unconsumed bytes in the buffer. */
+	size_t size() const { return length(); }
+
+	/** Determines whether the buffer has no unconsumed bytes. */
+	bool empty() const { return !length(); }
+
+	/** Retrieves an iterator which points to the first unconsumed byte in the buffer. */
+	const char* begin() const { return data(); }
+
+	/** Retrieves an iterator which points to one past the last byte in the buffer. */
+	const char* end() const { return data() + length(); }
+
+	/** Retrieves the number of buffers which share the underlying bytes with this one. */
+	long use_count() const { return buffer.use_count(); }
+
+	/** Retrieves a view of the unconsumed bytes in the buffer. */
+	std::string_view view() const { return std::string_view(data(), length()); }
+
+	/** Retrieves a view of the unconsumed bytes in the buffer. */
+	operator std::string_view() const { return view(); }
+
+	/** Consumes bytes from the start of this view of the buffer.
+	 * @param n The number of bytes to consume. Must not be more than length().
+	 */
+	void erase_front(size_t n)
+	{
+		offset += n;
+		if (offset >= (buffer ? buffer->length() : 0))
+		{
+			// Release our reference to the underlying bytes early.
+			buffer.reset();
+			offset = 0;
+		}
+	}
+};
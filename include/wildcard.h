@@ -0,0 +1,89 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+/** A glob pattern which has been parsed ahead of time so that it can be matched against many
+ * strings cheaply. Matching gives the same result as InspIRCd::Match and InspIRCd::MatchCIDR
+ * but the literal runs between wildcards are compared with memcmp/memmem against a case folded
+ * copy of the subject instead of being walked through the case map byte by byte.
+ */
+class CoreExport CompiledMask final
+{
+private:
+	/** A run of the pattern which does not contain a '*'. */
+	struct Segment final
+	{
+		/** The position of the run within the pattern. */
+		size_t offset;
+
+		/** The length of the run. */
+		size_t length;
+
+		/** Whether the run contains a '?' and therefore can not be compared with memcmp. */
+		bool wild;
+	};
+
+	/** The glob pattern this mask was compiled from. */
+	std::string mask;
+
+	/** The case map to use when matching or nullptr to use the national case map. */
+	const unsigned char* map;
+
+	/** The runs of the pattern which are separated by one or more '*'. */
+	std::vector<Segment> segments;
+
+	/** Whether the pattern contains a '*'. If not then the only segment must match the whole subject. */
+	bool hasstar = false;
+
+	/** The minimum length of a string that can match this pattern. */
+	size_t minlength = 0;
+
+	/** Whether the part of the pattern after the last '@' may be parsed as a CIDR range. */
+	bool maybecidr = false;
+
+	/** The case map that folded was built with. */
+	mutable const unsigned char* foldmap = nullptr;
+
+	/** The pattern folded using foldmap. */
+	mutable std::string folded;
+
+	/** Retrieves the pattern case folded using the specified map. */
+	const std::string& GetFolded(const unsigned char* curmap) const;
+
+public:
+	/** Compiles a glob pattern.
+	 * @param pattern The glob pattern to compile.
+	 * @param casemap The case map to use when matching or nullptr to use the national case map.
+	 */
+	CompiledMask(const std::string& pattern = "", const unsigned char* casemap = nullptr);
+
+	/** Retrieves the glob pattern this mask was compiled from. */
+	const std::string& GetMask() const { return mask; }
+
+	/** Determines whether a string matches this mask.
+	 * @param str The string to match against.
+	 * @return True if the string matches; otherwise, false.
+	 */
+	bool Match(std::string_view str) const;
+
+	/** Determines whether a string matches this mask as either a CIDR range or a glob pattern.
+	 * @param str The string to match against.
+	 * @return True if the string matches; otherwise, false.
+	 */
+	bool MatchCIDR(const std::string& str) const;
+};
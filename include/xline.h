@@ -145,6 +145,13 @@ public:
 	 */
 	virtual void OnAdd() { }
 
+	/** Retrieves the mask which either the real hostname or the IP address of a user must match
+	 * for Matches(User*) to return true. This allows XLineManager to index lines by host rather
+	 * than checking every line against every user.
+	 * @return The host mask or nullptr if this line has to be checked against every user.
+	 */
+	virtual const std::string* GetHostMask() const { return nullptr; }
+
 	/** The time the line was added.
 	 */
 	time_t set_time;
@@ -195,6 +202,8 @@ public:
 		: XLine(s_time, d, src, re, "K")
 		, usermask(user)
 		, hostmask(host)
+		, compileduser(user, ascii_case_insensitive_map)
+		, compiledhost(host, ascii_case_insensitive_map)
 	{
 		matchtext = this->usermask;
 		matchtext.append("@").append(this->hostmask);
@@ -208,6 +217,8 @@ public:
 
 	const std::string& Displayable() const override;
 
+	const std::string* GetHostMask() const override;
+
 	bool IsBurstable() override;
 
 	/** Username pattern to match. */
@@ -217,6 +228,12 @@ public:
 	std::string hostmask;
 
 	std::string matchtext;
+
+	/** Username pattern compiled for matching. */
+	CompiledMask compileduser;
+
+	/** Hostname pattern compiled for matching. */
+	CompiledMask compiledhost;
 };
 
 /** GLine class
@@ -237,6 +254,8 @@ public:
 		: XLine(s_time, d, src, re, "G")
 		, usermask(user)
 		, hostmask(host)
+		, compileduser(user, ascii_case_insensitive_map)
+		, compiledhost(host, ascii_case_insensitive_map)
 	{
 		matchtext = this->usermask;
 		matchtext.append("@").append(this->hostmask);
@@ -250,6 +269,8 @@ public:
 
 	const std::string& Displayable() const override;
 
+	const std::string* GetHostMask() const override;
+
 	/** Username pattern to match. */
 	std::string usermask;
 
@@ -257,6 +278,12 @@ public:
 	std::string hostmask;
 
 	std::string matchtext;
+
+	/** Username pattern compiled for matching. */
+	CompiledMask compileduser;
+
+	/** Hostname pattern compiled for matching. */
+	CompiledMask compiledhost;
 };
 
 /** ELine class
@@ -277,6 +304,8 @@ public:
 		: XLine(s_time, d, src, re, "E")
 		, usermask(user)
 		, hostmask(host)
+		, compileduser(user, ascii_case_insensitive_map)
+		, compiledhost(host, ascii_case_insensitive_map)
 	{
 		matchtext = this->usermask;
 		matchtext.append("@").append(this->hostmask);
@@ -292,6 +321,8 @@ public:
 
 	const std::string& Displayable() const override;
 
+	const std::string* GetHostMask() const override;
+
 	/** Username pattern to match. */
 	std::string usermask;
 
@@ -299,6 +330,12 @@ public:
 	std::string hostmask;
 
 	std::string matchtext;
+
+	/** Username pattern compiled for matching. */
+	CompiledMask compileduser;
+
+	/** Hostname pattern compiled for matching. */
+	CompiledMask compiledhost;
 };
 
 /** ZLine class
@@ -328,6 +365,8 @@ public:
 
 	const std::string& Displayable() const override;
 
+	const std::string* GetHostMask() const override;
+
 	/** IP mask (no user part)
 	 */
 	std::string ipaddr;
@@ -349,6 +388,7 @@ public:
 	QLine(time_t s_time, unsigned long d, const std::string& src, const std::string& re, const std::string& nickname)
 		: XLine(s_time, d, src, re, "Q")
 		, nick(nickname)
+		, compilednick(nickname)
 	{
 	}
 
@@ -363,6 +403,9 @@ public:
 	/** Nickname mask
 	 */
 	std::string nick;
+
+	/** Nickname mask compiled for matching. */
+	CompiledMask compilednick;
 };
 
 /** XLineFactory is used to generate an XLine pointer, given just the
@@ -410,6 +453,57 @@ public:
 	virtual ~XLineFactory() = default;
 };
 
+/** Indexes the lines of a single type by the host mask they match so that a user can be checked
+ * against them without calling XLine::Matches on every line. IP addresses and CIDR ranges are
+ * stored in a radix trie, masks without wildcards in a hash map and masks like *.example.com
+ * in a trie of reversed suffixes. Anything else is kept in a list which is always checked.
+ */
+class CoreExport XLineIndex final
+{
+private:
+	struct CIDRNode;
+	struct SuffixNode;
+
+	/** The lines which match an IPv4 CIDR range. */
+	std::unique_ptr<CIDRNode> cidr4;
+
+	/** The lines which match an IPv6 CIDR range. */
+	std::unique_ptr<CIDRNode> cidr6;
+
+	/** The lines which match an exact host keyed by the case folded host. */
+	std::unordered_map<std::string, std::vector<XLine*>> exact;
+
+	/** The lines which match any host ending in a literal suffix. */
+	std::unique_ptr<SuffixNode> suffixes;
+
+	/** The lines which can not be indexed. */
+	std::vector<XLine*> unindexed;
+
+	/** Adds the lines which may match a host or IP address to the candidate list. */
+	void FindCandidates(const std::string& host, std::vector<XLine*>& candidates) const;
+
+public:
+	XLineIndex();
+	~XLineIndex();
+
+	/** Adds a line to the index.
+	 * @param line The line to add.
+	 */
+	void Add(XLine* line);
+
+	/** Removes a line from the index.
+	 * @param line The line to remove.
+	 */
+	void Remove(XLine* line);
+
+	/** Retrieves the lines which may match a user. Every line that matches the user will be in
+	 * the candidate list but the caller still needs to call XLine::Matches on each of them.
+	 * @param user The user to find candidate lines for.
+	 * @param candidates The vector to store the candidate lines in.
+	 */
+	void GetCandidates(User* user, std::vector<XLine*>& candidates) const;
+};
+
 /** XLineManager is a class used to manage G-lines, K-lines, E-lines, Z-lines and Q-lines,
  * or any other line created by a module. It also manages XLineFactory classes which
  * can generate a specialized XLine for use by another module.
@@ -421,6 +515,9 @@ protected:
 	 */
 	std::vector<XLine *> pending_lines;
 
+	/** Whether an action has been queued to apply the pending lines at the end of the current main loop iteration. */
+	bool applyqueued = false;
+
 	/** Current xline factories
 	 */
 	XLineFactMap line_factory;
@@ -432,6 +529,9 @@ protected:
 	 */
 	XLineContainer lookup_lines;
 
+	/** The lines in lookup_lines indexed by host for each type of line. */
+	std::map<std::string, XLineIndex> line_index;
+
 public:
 
 	/** Constructor
@@ -548,6 +648,12 @@ public:
 	 */
 	void ApplyLines();
 
+	/** Apply any new lines that are pending to be applied at the end of the current main loop
+	 * iteration. This allows lines which are added in bulk (e.g. by services) to be applied in
+	 * a single pass over the local users rather than one pass per line.
+	 */
+	void QueueApplyLines();
+
 	/** Generates a /STATS response for the given X-line type.
 	 * @param type The type of X-line to look up.
 	 * @param context The stats context to respond with.
@@ -74,6 +74,15 @@ Membership* Channel::AddUser(User* user)
 		return nullptr;
 
 	Membership* memb = new(ret.first->second) Membership(user, this);
+	if (IS_LOCAL(user))
+	{
+		memb->localindex = localmembers.size();
+		localmembers.push_back(memb);
+	}
+	else
+	{
+		servermembers[user->server].count++;
+	}
 	return memb;
 }
 
@@ -84,6 +93,33 @@ void Channel::DelUser(User* user)
 		DelUser(it);
 }
 
+size_t Channel::ServerMembers::CountAtLeast(ModeHandler::Rank minrank) const
+{
+	if (!minrank)
+		return count;
+
+	size_t total = 0;
+	for (auto it = ranks.lower_bound(minrank); it != ranks.end(); ++it)
+		total += it->second;
+	return total;
+}
+
+void Channel::UpdateServerRank(ServerMembers& members, ModeHandler::Rank oldrank, ModeHandler::Rank newrank)
+{
+	if (oldrank == newrank)
+		return;
+
+	if (oldrank)
+	{
+		auto it = members.ranks.find(oldrank);
+		if (it != members.ranks.end() && !--it->second)
+			members.ranks.erase(it);
+	}
+
+	if (newrank)
+		members.ranks[newrank]++;
+}
+
 void Channel::CheckDestroy()
 {
 	if (!userlist.empty())
@@ -107,6 +143,25 @@ void Channel::CheckDestroy()
 void Channel::DelUser(const MemberMap::iterator& membiter)
 {
 	Membership* memb = membiter->second;
+	if (memb->localindex != SIZE_MAX)
+	{
+		// Move the last local member into the slot of the removed one.
+		Membership* last = localmembers.back();
+		localmembers[memb->localindex] = last;
+		last->localindex = memb->localindex;
+		localmembers.pop_back();
+	}
+	else
+	{
+		ServerMemberMap::iterator it = servermembers.find(memb->user->server);
+		if (it != servermembers.end())
+		{
+			UpdateServerRank(it->second, memb->GetRank(), 0);
+			if (!--it->second.count)
+				servermembers.erase(it);
+		}
+	}
+
 	memb->Cull();
 	memb->~Membership();
 	userlist.erase(membiter);
@@ -271,7 +326,7 @@ bool Channel::IsBanned(User* user)
 	{
 		for (const auto& entry : *bans)
 		{
-			if (CheckBan(user, entry.mask))
+			if (CheckBan(user, entry.GetCompiledBan()))
 				return true;
 		}
 	}
@@ -303,6 +358,39 @@ bool Channel::CheckBan(User* user, const std::string& mask)
 		InspIRCd::MatchCIDR(user->GetAddress(), suffix);
 }
 
+Channel::CompiledBan::CompiledBan(const std::string& banmask)
+	: mask(banmask)
+	, valid(banmask.find('@') != std::string::npos)
+	, nickuser(valid ? banmask.substr(0, banmask.find('@')) : std::string())
+	, host(valid ? banmask.substr(banmask.find('@') + 1) : std::string())
+{
+}
+
+bool Channel::CheckBan(User* user, const CompiledBan& ban)
+{
+	ModResult result;
+	FIRST_MOD_RESULT(OnCheckBan, result, (user, this, ban.mask));
+	if (result != MOD_RES_PASSTHRU)
+		return (result == MOD_RES_DENY);
+
+	if (!ban.valid)
+		return false;
+
+	std::string nickuser(user->nick);
+	nickuser.push_back('!');
+	const size_t userpos = nickuser.length();
+	if (!ban.nickuser.Match(nickuser.append(user->GetDisplayedUser())) &&
+		(user->GetDisplayedUser() == user->GetRealUser() || !ban.nickuser.Match(nickuser.replace(userpos, std::string::npos, user->GetRealUser()))))
+	{
+		// Neither the nick!user or nick!duser.
+		return false;
+	}
+
+	return ban.host.Match(user->GetRealHost()) ||
+		(user->GetDisplayedHost() != user->GetRealHost() && ban.host.Match(user->GetDisplayedHost())) ||
+		ban.host.MatchCIDR(user->GetAddress());
+}
+
 void Channel::PartUser(const MemberMap::iterator& membiter, const std::string& reason)
 {
 	User* user = membiter->first;
@@ -344,18 +432,31 @@ void Channel::Write(ClientProtocol::Event& protoev, char status, const CUList& e
 			minrank = mh->GetPrefixRank();
 	}
 
-	for (const auto& [u, memb] : userlist)
+	// Mark the excepted users instead of looking each member up in the list.
+	uint64_t exceptid = 0;
+	if (!except_list.empty())
 	{
-		LocalUser* user = IS_LOCAL(u);
-		if ((user) && (!except_list.count(user)))
+		exceptid = ServerInstance->Users.NextAlreadySentId();
+		for (auto* u : except_list)
 		{
-			/* User doesn't have the status we're after */
-			if (minrank && memb->GetRank() < minrank)
-				continue;
-
-			user->Send(protoev);
+			LocalUser* user = IS_LOCAL(u);
+			if (user)
+				user->already_sent = exceptid;
 		}
 	}
+
+	for (const auto* memb : localmembers)
+	{
+		LocalUser* user = static_cast<LocalUser*>(memb->user);
+		if (exceptid && user->already_sent == exceptid)
+			continue;
+
+		/* User doesn't have the status we're after */
+		if (minrank && memb->GetRank() < minrank)
+			continue;
+
+		user->Send(protoev);
+	}
 }
 
 const char* Channel::ChanModes(bool showsecret)
@@ -457,10 +558,15 @@ ModeHandler::Rank Channel::GetPrefixValue(User* user) const
 
 bool Membership::SetPrefix(PrefixMode* delta_mh, bool adding)
 {
-	if (adding)
-		return modes.insert(delta_mh).second;
-	else
-		return modes.erase(delta_mh);
+	const ModeHandler::Rank oldrank = GetRank();
+	const bool changed = adding ? modes.insert(delta_mh).second : modes.erase(delta_mh);
+	if (changed && localindex == SIZE_MAX)
+	{
+		Channel::ServerMemberMap::iterator it = chan->servermembers.find(user->server);
+		if (it != chan->servermembers.end())
+			Channel::UpdateServerRank(it->second, oldrank, GetRank());
+	}
+	return changed;
 }
 
 void Membership::WriteNotice(const std::string& text) const
@@ -65,7 +65,31 @@ const ClientProtocol::SerializedMessage& ClientProtocol::Serializer::SerializeFo
 		msg.msginit_done = true;
 		evprov.Call(&MessageTagProvider::OnPopulateTags, msg);
 	}
-	return msg.GetSerialized(Message::SerializedInfo(this, MakeTagWhitelist(user, msg.GetTags())));
+
+	// Work out whether the tags a user gets only depend on the capabilities
+	// they have enabled. Tags are only ever added so the count is enough to
+	// tell whether this needs to be checked again.
+	if (msg.profiletags != msg.tags.size())
+	{
+		msg.profiletags = msg.tags.size();
+		msg.profiles.clear();
+		msg.profilesafe = std::all_of(msg.tags.begin(), msg.tags.end(), [](const auto& tag) {
+			return tag.second.tagprov->IsCapabilityBased();
+		});
+	}
+
+	if (!msg.profilesafe)
+		return msg.GetSerialized(Message::SerializedInfo(this, MakeTagWhitelist(user, msg.GetTags())));
+
+	for (const auto& profile : msg.profiles)
+	{
+		if (profile.serializer == this && profile.capprofile == user->capprofile)
+			return msg.serlist[profile.serindex].second;
+	}
+
+	const size_t serindex = msg.GetSerializedIndex(Message::SerializedInfo(this, MakeTagWhitelist(user, msg.GetTags())));
+	msg.profiles.push_back({ this, user->capprofile, serindex });
+	return msg.serlist[serindex].second;
 }
 
 std::string ClientProtocol::Message::EscapeTag(const std::string& value)
@@ -144,17 +168,22 @@ std::string ClientProtocol::Message::UnescapeTag(const std::string& value)
 
 
 const ClientProtocol::SerializedMessage& ClientProtocol::Message::GetSerialized(const SerializedInfo& serializeinfo) const
+{
+	return serlist[GetSerializedIndex(serializeinfo)].second;
+}
+
+size_t ClientProtocol::Message::GetSerializedIndex(const SerializedInfo& serializeinfo) const
 {
 	// First check if the serialized line they're asking for is in the cache
-	for (const auto& [info, msg] : serlist)
+	for (size_t i = 0; i < serlist.size(); ++i)
 	{
-		if (info == serializeinfo)
-			return msg;
+		if (serlist[i].first == serializeinfo)
+			return i;
 	}
 
 	// Not cached, generate it and put it in the cache for later use
 	serlist.push_back(std::make_pair(serializeinfo, serializeinfo.serializer->Serialize(*this, serializeinfo.tagwl)));
-	return serlist.back().second;
+	return serlist.size() - 1;
 }
 
 void ClientProtocol::Event::GetMessagesForUser(LocalUser* user, MessageList& messagelist)
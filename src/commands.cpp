@@ -311,21 +311,27 @@ void CommandParser::ProcessCommand(LocalUser* user, std::string& command, Comman
 	{
 		/* passed all checks.. first, do the (ugly) stats counters. */
 		handler->use_count++;
+		const auto starttime = std::chrono::steady_clock::now();
+		const unsigned long startsent = ServerInstance->Stats.Sent;
 
 		/* module calls too */
 		FIRST_MOD_RESULT(OnPreCommand, MOD_RESULT, (command, command_p, user, true));
 		if (MOD_RESULT == MOD_RES_DENY)
 		{
 			FOREACH_MOD(OnCommandBlocked, (command, command_p, user));
-			return;
 		}
+		else
+		{
+			/*
+			 * WARNING: be careful, the user may be deleted soon
+			 */
+			CmdResult result = handler->Handle(user, command_p);
 
-		/*
-		 * WARNING: be careful, the user may be deleted soon
-		 */
-		CmdResult result = handler->Handle(user, command_p);
+			FOREACH_MOD(OnPostCommand, (handler, command_p, user, result, false));
+		}
 
-		FOREACH_MOD(OnPostCommand, (handler, command_p, user, result, false));
+		handler->use_time += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - starttime).count();
+		handler->use_output += ServerInstance->Stats.Sent - startsent;
 	}
 }
 
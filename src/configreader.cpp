@@ -380,8 +380,11 @@ void ServerConfig::Fill()
 
 	// Read the <performance> config.
 	const auto& performance = ConfValue("performance");
+	CoalesceWrites = performance->getBool("coalescewrites", true);
 	MaxConn = performance->getNum<int>("somaxconn", SOMAXCONN, 1);
 	NetBufferSize = performance->getNum<size_t>("netbuffersize", 10240, 1024, 65534);
+	NetThreads = performance->getNum<size_t>("netthreads", 0, 0, 64);
+	ProfileHooks = performance->getBool("profilehooks");
 	SoftLimit = performance->getNum<size_t>("softlimit", (SocketEngine::GetMaxFds() > 0 ? SocketEngine::GetMaxFds() : SIZE_MAX), 10);
 	TimeSkipWarn = performance->getDuration("timeskipwarn", 2, 0, 30);
 
@@ -471,6 +474,8 @@ void ServerConfig::Apply(ServerConfig* old, const std::string& useruid)
 
 	// Check errors before dealing with failed binds, since continuing on failed bind is wanted in some circumstances.
 	valid = errstr.str().empty();
+	if (valid)
+		HookProfiler::SetEnabled(ProfileHooks);
 
 	auto binds = ConfTags("bind");
 	if (binds.empty())
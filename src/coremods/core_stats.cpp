@@ -28,6 +28,7 @@
 #include "inspircd.h"
 #include "modules/cap.h"
 #include "modules/stats.h"
+#include "timeutils.h"
 #include "utility/string.h"
 #include "xline.h"
 
@@ -55,6 +56,11 @@ public:
 	{
 		return statscap.IsEnabled(user);
 	}
+
+	bool IsCapabilityBased() const override
+	{
+		return true;
+	}
 };
 
 
@@ -228,9 +234,64 @@ void CommandStats::DoStats(Stats::Context& stats)
 			stats.AddRow(249, "Read events:  "+ConvToStr(sestats.ReadEvents));
 			stats.AddRow(249, "Write events: "+ConvToStr(sestats.WriteEvents));
 			stats.AddRow(249, "Error events: "+ConvToStr(sestats.ErrorEvents));
+			stats.AddRow(249, "Elided changes: "+ConvToStr(sestats.ElidedChanges));
 			break;
 		}
 
+		/* stats h (show how long modules have spent handling events) */
+		case 'h':
+		{
+			if (!HookProfiler::IsEnabled())
+			{
+				stats.AddRow(249, "The hook profiler is not enabled. Set <performance:profilehooks> to enable it.");
+				break;
+			}
+
+			std::vector<const HookProfiler::Entry*> entries;
+			for (const auto& [_, entry] : HookProfiler::GetEntries())
+			{
+				if (entry.calls)
+					entries.push_back(&entry);
+			}
+			std::sort(entries.begin(), entries.end(), [](const auto* lhs, const auto* rhs) {
+				return lhs->total > rhs->total;
+			});
+
+			stats.AddRow(249, fmt::format("Profiling for {} (reset with /REHASH -profile)",
+				Duration::ToString(ServerInstance->Time() - HookProfiler::GetLastReset())));
+			stats.AddRow(249, "module event calls total_us avg_us p50_us p99_us max_us");
+			for (const auto* entry : entries)
+			{
+				stats.AddRow(249, fmt::format("{} {} {} {} {} {} {} {}", entry->modname, entry->event, entry->calls,
+					entry->total / 1000, entry->total / entry->calls / 1000, entry->GetPercentile(50) / 1000,
+					entry->GetPercentile(99) / 1000, entry->max / 1000));
+			}
+		}
+		break;
+
+		/* stats w (show how long the phases of the main loop take) */
+		case 'w':
+		{
+			const auto addrow = [&stats](const char* label, const insp::histogram& hist, double scale) {
+				stats.AddRow(249, fmt::format("{} {} {:.1f} {:.1f} {:.1f} {:.1f} {:.1f}", label, hist.count(),
+					hist.percentile(50) / scale, hist.percentile(90) / scale, hist.percentile(99) / scale,
+					hist.percentile(99.9) / scale, hist.max() / scale));
+			};
+
+			const MainLoopStats& loopstats = ServerInstance->LoopStats;
+			stats.AddRow(249, fmt::format("Main loop timings for {} (reset with /REHASH -profile)",
+				Duration::ToString(ServerInstance->Time() - loopstats.GetLastReset())));
+			stats.AddRow(249, "phase count p50_us p90_us p99_us p999_us max_us");
+			for (uint8_t phase = 0; phase < MainLoopStats::PHASE_END; ++phase)
+				addrow(MainLoopStats::GetPhaseName(static_cast<MainLoopStats::Phase>(phase)), loopstats.GetPhase(static_cast<MainLoopStats::Phase>(phase)), 1000.0);
+			addrow("iteration", loopstats.GetIterations(), 1000.0);
+			addrow("busy", loopstats.GetBusy(), 1000.0);
+
+			stats.AddRow(249, "since-boot count p50 p90 p99 p999 max");
+			addrow("events-per-wakeup", SocketEngine::GetStats().EventsPerWakeup, 1.0);
+		}
+		break;
+
 		/* stats m (list number of times each command has been used, plus bytecount) */
 		case 'm':
 		{
@@ -239,7 +300,7 @@ void CommandStats::DoStats(Stats::Context& stats)
 				if (command->use_count)
 				{
 					/* RPL_STATSCOMMANDS */
-					stats.AddRow(212, command->name, command->use_count);
+					stats.AddRow(212, command->name, command->use_count, command->use_output, command->use_time / 1000);
 				}
 			}
 		}
@@ -405,6 +466,17 @@ public:
 		cmd.userstats = security->getString("userstats", "Pu");
 	}
 
+	void OnModuleRehash(User* user, const std::string& param) override
+	{
+		if (!irc::equals(param, "profile"))
+			return;
+
+		ServerInstance->LoopStats.Reset(ServerInstance->Time());
+		if (HookProfiler::IsEnabled())
+			HookProfiler::Reset();
+		ServerInstance->SNO.WriteToSnoMask('r', "The hook profiler and main loop timings have been reset.");
+	}
+
 };
 
 MODULE_INIT(CoreModStats)
@@ -79,6 +79,10 @@ CmdResult CommandUser::CheckRegister(LocalUser* user)
 		FIRST_MOD_RESULT(OnUserRegister, MOD_RESULT, (user));
 		if (MOD_RESULT == MOD_RES_DENY)
 			return CmdResult::FAILURE;
+
+		// Check whether modules are ready for the user to finish connecting straight away
+		// instead of waiting for the next scheduled check.
+		user->ScheduleHousekeeping(ServerInstance->Time());
 	}
 
 	return CmdResult::SUCCESS;
@@ -182,9 +182,9 @@ public:
 		}
 
 		bool hostmatches = false;
-		for (const auto& host : klass->GetHosts())
+		for (const auto& host : klass->GetCompiledHosts())
 		{
-			if (InspIRCd::MatchCIDR(user->GetAddress(), host) || InspIRCd::MatchCIDR(user->GetRealHost(), host))
+			if (host.MatchCIDR(user->GetAddress()) || host.MatchCIDR(user->GetRealHost()))
 			{
 				hostmatches = true;
 				break;
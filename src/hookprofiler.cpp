@@ -0,0 +1,93 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "inspircd.h"
+
+bool HookProfiler::enabled = false;
+time_t HookProfiler::lastreset = 0;
+HookProfiler::EntryMap HookProfiler::entries;
+
+unsigned long long HookProfiler::Entry::GetPercentile(unsigned int percentile) const
+{
+	// The number of calls which must be at or below the percentile.
+	const unsigned long long wanted = (static_cast<unsigned long long>(calls) * percentile + 99) / 100;
+
+	unsigned long long seen = 0;
+	for (size_t bucket = 0; bucket < HistogramSize; ++bucket)
+	{
+		seen += histogram[bucket];
+		if (seen && seen >= wanted)
+			return std::min(1ULL << (bucket + 1), max);
+	}
+	return max;
+}
+
+HookProfiler::Entry& HookProfiler::GetEntry(const Module* mod, const void* id, std::string_view name, const Module* provider)
+{
+	auto [it, inserted] = entries.try_emplace(Key(mod, id));
+	if (inserted)
+	{
+		Entry& entry = it->second;
+		entry.module = mod;
+		entry.provider = provider;
+		entry.modname = mod ? mod->ModuleFile : "<core>";
+		entry.event = name;
+	}
+	return it->second;
+}
+
+void HookProfiler::Record(Entry& entry, std::chrono::steady_clock::duration duration)
+{
+	const auto nanoseconds = static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+	entry.calls++;
+	entry.total += nanoseconds;
+	entry.max = std::max(entry.max, nanoseconds);
+
+	// Find the highest set bit to determine which power of two bucket to use.
+	size_t bucket = 0;
+	for (unsigned long long remaining = nanoseconds >> 1; remaining && bucket < HistogramSize - 1; remaining >>= 1)
+		bucket++;
+	entry.histogram[bucket]++;
+}
+
+void HookProfiler::SetEnabled(bool enable)
+{
+	if (enable && !enabled)
+		Reset();
+	enabled = enable;
+}
+
+void HookProfiler::Reset()
+{
+	// The entries are reset in place instead of being erased as a timer for an
+	// event which is currently being handled may still refer to them.
+	for (auto& [_, entry] : entries)
+	{
+		entry.calls = 0;
+		entry.total = 0;
+		entry.max = 0;
+		entry.histogram.fill(0);
+	}
+	lastreset = ServerInstance->Time();
+}
+
+void HookProfiler::Forget(const Module* mod)
+{
+	std::erase_if(entries, [mod](const auto& it) {
+		return it.second.module == mod || it.second.provider == mod;
+	});
+}
@@ -394,6 +394,7 @@ void InspIRCd::Cleanup()
 		ServerInstance->Users.QuitUser(list.front(), quitmsg);
 
 	GlobalCulls.Apply();
+	NetThreads.Stop();
 	Modules.UnloadAll();
 
 	/* Delete objects dynamically allocated in constructor (destructor would be more appropriate, but we're likely exiting) */
@@ -621,9 +622,12 @@ void InspIRCd::Run()
 {
 	UpdateTime();
 	time_t OLDTIME = TIME.tv_sec;
+	LoopStats.Reset(OLDTIME);
 
 	while (true)
 	{
+		LoopStats.BeginIteration();
+
 		/* Check if there is a config thread which has finished executing but has not yet been freed */
 		if (this->ConfigThread && this->ConfigThread->IsDone())
 		{
@@ -635,6 +639,11 @@ void InspIRCd::Run()
 
 		UpdateTime();
 
+		// Timers can have a resolution of less than a second so they are ticked on
+		// every iteration of the main loop.
+		Timers.TickTimers();
+		LoopStats.EndPhase(MainLoopStats::PHASE_TIMERS);
+
 		// Normally we want to limit the mainloop to processing data
 		// once a second but this can cause problems with testing
 		// software like irctest. Don't define this unless you know
@@ -651,14 +660,12 @@ void InspIRCd::Run()
 			if ((TIME.tv_sec % 3600) == 0)
 				FOREACH_MOD(OnGarbageCollect, ());
 
-			Timers.TickTimers();
-			Users.DoBackgroundUserStuff();
-
 			if ((TIME.tv_sec % 5) == 0)
 			{
 				FOREACH_MOD(OnBackgroundTimer, (TIME.tv_sec));
 				SNO.FlushSnotices();
 			}
+			LoopStats.EndPhase(MainLoopStats::PHASE_BACKGROUND);
 		}
 
 		/* Call the socket engine to wait on the active
@@ -668,12 +675,14 @@ void InspIRCd::Run()
 		 * This will cause any read or write events to be
 		 * dispatched to their handlers.
 		 */
-		SocketEngine::DispatchTrialWrites();
-		SocketEngine::DispatchEvents();
+		SocketEngine::Dispatch(Config->CoalesceWrites);
 
 		/* if any users were quit, take them out */
 		GlobalCulls.Apply();
+		LoopStats.EndPhase(MainLoopStats::PHASE_CULLS);
+
 		AtomicActions.Run();
+		LoopStats.EndPhase(MainLoopStats::PHASE_ACTIONS);
 
 		if (s_signal)
 		{
@@ -462,6 +462,7 @@ void ModuleManager::DoSafeUnload(Module* mod)
 	DetachAll(mod);
 
 	Modules.erase(modfind);
+	HookProfiler::Forget(mod);
 	ServerInstance->GlobalCulls.AddItem(mod);
 
 	ServerInstance->Logs.Normal("MODULE", "The {} module was unloaded", mod->ModuleFile);
@@ -0,0 +1,245 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// $CompilerFlags: find_compiler_flags("zlib")
+/// $LinkerFlags: find_linker_flags("zlib" "-lz")
+
+/// $PackageInfo: require_system("arch") pkgconf zlib
+/// $PackageInfo: require_system("centos") pkgconfig zlib-devel
+/// $PackageInfo: require_system("darwin") pkg-config zlib
+/// $PackageInfo: require_system("debian") pkg-config zlib1g-dev
+/// $PackageInfo: require_system("rocky") pkgconfig zlib-devel
+/// $PackageInfo: require_system("ubuntu") pkg-config zlib1g-dev
+
+
+#include "inspircd.h"
+#include "modules/compress.h"
+
+#include <zlib.h>
+
+#ifdef _WIN32
+# pragma comment(lib, "zlib.lib")
+#endif
+
+class ZlibHookProvider final
+	: public CompressIOHookProvider
+{
+public:
+	// The level to compress data which is sent at.
+	int level = Z_DEFAULT_COMPRESSION;
+
+	ZlibHookProvider(Module* mod)
+		: CompressIOHookProvider(mod, "zlib")
+	{
+	}
+
+	void OnAccept(StreamSocket* sock, const irc::sockets::sockaddrs& client, const irc::sockets::sockaddrs& server) override;
+
+	void OnConnect(StreamSocket* sock) override;
+};
+
+class ZlibHook final
+	: public CompressIOHook
+{
+private:
+	// The amount of space to grow an output buffer by when (de)compressing.
+	static constexpr size_t ChunkSize = 16 * 1024;
+
+	// The stream which compresses the data we send.
+	z_stream deflater = { };
+
+	// The stream which decompresses the data we receive.
+	z_stream inflater = { };
+
+	// Whether the data we receive is compressed.
+	bool decompressing = false;
+
+	static void SetError(StreamSocket* sock, const char* action, const z_stream& stream, int result)
+	{
+		sock->SetError(fmt::format("Unable to {} data: {}", action, stream.msg ? stream.msg : zError(result)));
+	}
+
+	bool Deflate(StreamSocket* sock, int flush, std::string& out)
+	{
+		do
+		{
+			const size_t oldsize = out.size();
+			out.resize(oldsize + ChunkSize);
+			deflater.next_out = reinterpret_cast<Bytef*>(out.data() + oldsize);
+			deflater.avail_out = ChunkSize;
+
+			const int result = deflate(&deflater, flush);
+			out.resize(oldsize + ChunkSize - deflater.avail_out);
+
+			// Z_BUF_ERROR just means that no progress was possible.
+			if (result != Z_OK && result != Z_BUF_ERROR)
+			{
+				SetError(sock, "compress", deflater, result);
+				return false;
+			}
+		}
+		while (!deflater.avail_out);
+		return true;
+	}
+
+	bool Inflate(StreamSocket* sock, const std::string& in, std::string& out)
+	{
+		const auto starttime = std::chrono::steady_clock::now();
+		const size_t prevsize = out.size();
+
+		inflater.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+		inflater.avail_in = static_cast<uInt>(in.size());
+		do
+		{
+			const size_t oldsize = out.size();
+			out.resize(oldsize + ChunkSize);
+			inflater.next_out = reinterpret_cast<Bytef*>(out.data() + oldsize);
+			inflater.avail_out = ChunkSize;
+
+			const int result = inflate(&inflater, Z_NO_FLUSH);
+			out.resize(oldsize + ChunkSize - inflater.avail_out);
+
+			// We never end the stream so the remote end shouldn't either.
+			if (result != Z_OK && result != Z_BUF_ERROR)
+			{
+				SetError(sock, "decompress", inflater, result);
+				return false;
+			}
+		}
+		while (!inflater.avail_out);
+
+		stats.compressed_in += in.size();
+		stats.raw_in += out.size() - prevsize;
+		stats.time += std::chrono::steady_clock::now() - starttime;
+		return true;
+	}
+
+public:
+	ZlibHook(const std::shared_ptr<IOHookProvider>& Prov, StreamSocket* sock, int level)
+		: CompressIOHook(Prov)
+	{
+		Insert(sock);
+
+		const int deflateresult = deflateInit(&deflater, level);
+		if (deflateresult != Z_OK)
+			SetError(sock, "compress", deflater, deflateresult);
+
+		const int inflateresult = inflateInit(&inflater);
+		if (inflateresult != Z_OK)
+			SetError(sock, "decompress", inflater, inflateresult);
+	}
+
+	~ZlibHook() override
+	{
+		deflateEnd(&deflater);
+		inflateEnd(&inflater);
+	}
+
+	ssize_t OnStreamSocketWrite(StreamSocket* sock, StreamSocket::SendQueue& uppersendq) override
+	{
+		if (uppersendq.empty())
+			return 1;
+
+		const auto starttime = std::chrono::steady_clock::now();
+
+		std::string out;
+		for (const auto& elem : uppersendq)
+		{
+			deflater.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(elem.data()));
+			deflater.avail_in = static_cast<uInt>(elem.length());
+			if (!Deflate(sock, Z_NO_FLUSH, out))
+				return -1;
+		}
+
+		// Flush at the end of every write so that the remote end can act on
+		// everything we have sent without having to wait for more data.
+		if (!Deflate(sock, Z_SYNC_FLUSH, out))
+			return -1;
+
+		stats.raw_out += uppersendq.bytes();
+		stats.compressed_out += out.size();
+		stats.time += std::chrono::steady_clock::now() - starttime;
+
+		uppersendq.clear();
+		GetSendQ().push_back(std::move(out));
+		return 1;
+	}
+
+	ssize_t OnStreamSocketRead(StreamSocket* sock, std::string& destrecvq) override
+	{
+		std::string& recvq = GetRecvQ();
+		if (!decompressing)
+		{
+			destrecvq.append(recvq);
+			recvq.clear();
+			return 1;
+		}
+
+		const bool success = Inflate(sock, recvq, destrecvq);
+		recvq.clear();
+		return success ? 1 : -1;
+	}
+
+	bool StartDecompressing(StreamSocket* sock, std::string& data) override
+	{
+		decompressing = true;
+
+		std::string out;
+		if (!Inflate(sock, data, out))
+			return false;
+
+		data.swap(out);
+		return true;
+	}
+};
+
+void ZlibHookProvider::OnAccept(StreamSocket* sock, const irc::sockets::sockaddrs& client, const irc::sockets::sockaddrs& server)
+{
+	new ZlibHook(shared_from_this(), sock, level);
+}
+
+void ZlibHookProvider::OnConnect(StreamSocket* sock)
+{
+	new ZlibHook(shared_from_this(), sock, level);
+}
+
+class ModuleCompressZlib final
+	: public Module
+{
+private:
+	std::shared_ptr<ZlibHookProvider> hookprov;
+
+public:
+	ModuleCompressZlib()
+		: Module(VF_VENDOR, "Allows server links to be compressed using the zlib library.")
+		, hookprov(std::make_shared<ZlibHookProvider>(this))
+	{
+	}
+
+	void init() override
+	{
+		ServerInstance->Logs.Normal(MODNAME, "Module was compiled against zlib version {} and is running against version {}",
+			ZLIB_VERSION, zlibVersion());
+	}
+
+	void ReadConfig(ConfigStatus& status) override
+	{
+		const auto& tag = ServerInstance->Config->ConfValue("zlib");
+		hookprov->level = tag->getNum<int>("level", Z_DEFAULT_COMPRESSION, Z_DEFAULT_COMPRESSION, Z_BEST_COMPRESSION);
+	}
+};
+
+MODULE_INIT(ModuleCompressZlib)
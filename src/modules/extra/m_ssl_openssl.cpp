@@ -43,13 +43,17 @@
 #include "inspircd.h"
 #include "iohook.h"
 #include "modules/ssl.h"
+#include "modules/stats.h"
 #include "stringutils.h"
+#include "threadsocket.h"
 #include "timeutils.h"
 #include "utility/string.h"
 
+#include <openssl/core_names.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/dh.h>
+#include <openssl/rand.h>
 
 #ifdef _WIN32
 # define timegm _mkgmtime
@@ -61,10 +65,13 @@
 # error OpenSSL 3.0.0 or newer is required by the ssl_openssl module.
 #endif
 
-static bool SelfSigned = false;
+static thread_local bool SelfSigned = false;
 static int exdataindex;
+static int ctxexdataindex;
 static Module* thismod;
 
+class OpenSSLIOHook;
+
 char* get_error()
 {
 	return ERR_error_string(ERR_get_error(), nullptr);
@@ -72,6 +79,7 @@ char* get_error()
 
 static int OnVerify(int preverify_ok, X509_STORE_CTX* ctx);
 static void StaticSSLInfoCallback(const SSL* ssl, int where, int rc);
+static int StaticTicketKeyCallback(SSL* ssl, unsigned char* keyname, unsigned char* iv, EVP_CIPHER_CTX* cctx, EVP_MAC_CTX* hctx, int enc);
 
 namespace OpenSSL
 {
@@ -220,6 +228,35 @@ namespace OpenSSL
 			return SSL_CTX_clear_options(ctx, clearoptions);
 		}
 
+		void EnableSessionCache(const std::string& idctx, long size, long timeout, void* ticketkeys)
+		{
+			ERR_clear_error();
+			SSL_CTX_set_session_id_context(ctx, reinterpret_cast<const unsigned char*>(idctx.data()), static_cast<unsigned int>(std::min<size_t>(idctx.length(), SSL_MAX_SID_CTX_LENGTH)));
+			SSL_CTX_set_timeout(ctx, timeout);
+			if (size > 0)
+			{
+				SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+				SSL_CTX_sess_set_cache_size(ctx, size);
+			}
+
+			if (ticketkeys)
+			{
+				SSL_CTX_set_ex_data(ctx, ctxexdataindex, ticketkeys);
+				SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, StaticTicketKeyCallback);
+				SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+			}
+		}
+
+		SSL_CTX* GetContext() const
+		{
+			return ctx;
+		}
+
+		void EnableKernelTLS()
+		{
+			SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+		}
+
 		void SetVerifyCert()
 		{
 			SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_CLIENT_ONCE, OnVerify);
@@ -240,6 +277,113 @@ namespace OpenSSL
 		}
 	};
 
+	/** Manages the keys which are used to encrypt stateless session tickets. The current key is
+	 * replaced once per session lifetime and the previous one is kept around so tickets which were
+	 * issued shortly before the rotation can still be used.
+	 */
+	class TicketKeys final
+	{
+	private:
+		struct Key final
+		{
+			unsigned char name[16];
+			unsigned char aeskey[32];
+			unsigned char hmackey[32];
+			time_t created;
+		};
+
+		/** Guards the keys as tickets can be issued from the handshake threads. */
+		std::mutex mutex;
+
+		/** The current key followed by the previous key. */
+		std::deque<Key> keys;
+
+		/** The number of seconds that a key is used to issue tickets for. */
+		const time_t lifetime;
+
+		bool Rotate(time_t now)
+		{
+			Key key;
+			if (RAND_bytes(key.name, sizeof(key.name)) <= 0 || RAND_priv_bytes(key.aeskey, sizeof(key.aeskey)) <= 0 || RAND_priv_bytes(key.hmackey, sizeof(key.hmackey)) <= 0)
+				return false;
+
+			key.created = now;
+			keys.push_front(key);
+			while (keys.size() > 2)
+			{
+				OPENSSL_cleanse(&keys.back(), sizeof(Key));
+				keys.pop_back();
+			}
+			return true;
+		}
+
+		static bool SetHMACKey(EVP_MAC_CTX* hctx, Key& key)
+		{
+			OSSL_PARAM params[] = {
+				OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmackey, sizeof(key.hmackey)),
+				OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0),
+				OSSL_PARAM_construct_end(),
+			};
+			return EVP_MAC_CTX_set_params(hctx, params);
+		}
+
+	public:
+		/** The number of tickets which have been issued. */
+		std::atomic_ulong issued = { 0 };
+
+		/** The number of tickets which were rejected because their key has been discarded. */
+		std::atomic_ulong expired = { 0 };
+
+		TicketKeys(time_t keylifetime)
+			: lifetime(keylifetime)
+		{
+		}
+
+		~TicketKeys()
+		{
+			for (auto& key : keys)
+				OPENSSL_cleanse(&key, sizeof(Key));
+		}
+
+		int OnTicket(unsigned char* keyname, unsigned char* iv, EVP_CIPHER_CTX* cctx, EVP_MAC_CTX* hctx, int enc)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (enc)
+			{
+				const time_t now = time(nullptr);
+				if ((keys.empty() || keys.front().created + lifetime <= now) && !Rotate(now))
+					return -1;
+
+				Key& key = keys.front();
+				memcpy(keyname, key.name, sizeof(key.name));
+				if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) <= 0)
+					return -1;
+
+				if (!EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), nullptr, key.aeskey, iv) || !SetHMACKey(hctx, key))
+					return -1;
+
+				issued++;
+				return 1;
+			}
+
+			for (size_t i = 0; i < keys.size(); ++i)
+			{
+				Key& key = keys[i];
+				if (memcmp(keyname, key.name, sizeof(key.name)))
+					continue;
+
+				if (!SetHMACKey(hctx, key) || !EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), nullptr, key.aeskey, iv))
+					return -1;
+
+				// Ask for a new ticket if this one was issued with the previous key.
+				return i ? 2 : 1;
+			}
+
+			expired++;
+			return 0;
+		}
+	};
+
 	class Profile final
 	{
 		/** Name of this profile
@@ -267,6 +411,19 @@ namespace OpenSSL
 		 */
 		const unsigned int outrecsize;
 
+		/** True if the kernel should encrypt outgoing data once the handshake is done, false if not
+		 */
+		const bool ktls;
+
+		/** Keys for encrypting session tickets or nullptr if session tickets are disabled
+		 */
+		std::unique_ptr<TicketKeys> ticketkeys;
+
+		/** The number of incoming sessions which were resumed and which required a full handshake
+		 */
+		unsigned long resumedhandshakes = 0;
+		unsigned long fullhandshakes = 0;
+
 		static int error_callback(const char* str, size_t len, void* u)
 		{
 			Profile* profile = reinterpret_cast<Profile*>(u);
@@ -323,6 +480,7 @@ namespace OpenSSL
 			, clientctx(SSL_CTX_new(TLS_client_method()))
 			, allowrenego(tag->getBool("renegotiation")) // Disallow by default
 			, outrecsize(tag->getNum<unsigned int>("outrecsize", 2048, 512, 16384))
+			, ktls(tag->getBool("ktls"))
 		{
 			irc::spacesepstream hashstream(tag->getString("hash", "sha256", 1));
 			for (std::string hash; hashstream.GetToken(hash); )
@@ -363,6 +521,22 @@ namespace OpenSSL
 			SetContextOptions("server", tag, ctx);
 			SetContextOptions("client", tag, clientctx);
 
+			// Allow clients to resume sessions without a full handshake.
+			const unsigned long sessiontimeout = tag->getDuration("sessiontimeout", 60*60, 1);
+			if (tag->getBool("sessiontickets", true))
+				ticketkeys = std::make_unique<TicketKeys>(sessiontimeout);
+			ctx.EnableSessionCache(name, tag->getNum<long>("sessioncachesize", 10000, 0), sessiontimeout, ticketkeys.get());
+
+			if (ktls)
+			{
+#ifdef OPENSSL_NO_KTLS
+				ServerInstance->Logs.Warning(MODNAME, "Unable to enable kernel TLS for the {} profile as OpenSSL was built without support for it.", name);
+#else
+				ctx.EnableKernelTLS();
+				clientctx.EnableKernelTLS();
+#endif
+			}
+
 			/* Load our keys and certificates
 			 * NOTE: OpenSSL's error logging API sucks, don't blame us for this clusterfuck.
 			 */
@@ -405,6 +579,26 @@ namespace OpenSSL
 		const std::vector<const EVP_MD*> GetDigests() { return digests; }
 		bool AllowRenegotiation() const { return allowrenego; }
 		unsigned int GetOutgoingRecordSize() const { return outrecsize; }
+		bool UseKernelTLS() const { return ktls; }
+
+		void OnHandshakeComplete(SSL* sess)
+		{
+			if (!SSL_is_server(sess))
+				return;
+
+			if (SSL_session_reused(sess))
+				resumedhandshakes++;
+			else
+				fullhandshakes++;
+		}
+
+		void GetStats(Stats::Context& stats) const
+		{
+			SSL_CTX* sctx = ctx.GetContext();
+			stats.AddGenericRow(fmt::format("The \"{}\" TLS profile resumed {} sessions and performed {} full handshakes ({} cache misses, {} cached sessions, {} tickets issued, {} tickets with expired keys)",
+				name, resumedhandshakes, fullhandshakes, SSL_CTX_sess_misses(sctx), SSL_CTX_sess_number(sctx),
+				ticketkeys ? ticketkeys->issued.load() : 0, ticketkeys ? ticketkeys->expired.load() : 0));
+		}
 	};
 
 	namespace BIOMethod
@@ -446,8 +640,145 @@ namespace OpenSSL
 			return meth;
 		}
 	}
+
+	/** The transport which sits underneath an OpenSSL session. */
+	struct Transport final
+	{
+		/** The socket which ciphertext is sent to and received from. */
+		StreamSocket* const sock;
+
+		/** Ciphertext which has been received from the socket but not consumed by OpenSSL yet. */
+		std::string recvq;
+
+		/** Ciphertext which has been produced by OpenSSL but not sent to the socket yet. */
+		std::string sendq;
+
+		/** Whether the session is being driven by a handshake thread. When this is set OpenSSL must
+		 * only use the buffers above and never touch the socket directly.
+		 */
+		bool staged = false;
+
+		Transport(StreamSocket* s)
+			: sock(s)
+		{
+		}
+	};
+
+	/** A step of a TLS handshake which can be performed on a handshake thread. */
+	struct HandshakeJob final
+	{
+		/** The hook which created this job or nullptr if it was closed whilst the job was queued. */
+		OpenSSLIOHook* hook;
+
+		/** The session to perform the handshake on. */
+		SSL* const sess;
+
+		/** The transport underneath the session. This is kept alive until the job has finished. */
+		const std::shared_ptr<Transport> transport;
+
+		/** The value returned by SSL_do_handshake(). */
+		int ret = -1;
+
+		/** The value returned by SSL_get_error() if the handshake did not complete. */
+		int err = SSL_ERROR_NONE;
+
+		/** Whether the peer certificate is self signed. */
+		bool selfsigned = false;
+
+		HandshakeJob(OpenSSLIOHook* h, SSL* s, const std::shared_ptr<Transport>& t)
+			: hook(h)
+			, sess(s)
+			, transport(t)
+		{
+		}
+
+		/** Performs as much of the handshake as is possible with the ciphertext that is available. */
+		void Run()
+		{
+			ERR_clear_error();
+			SelfSigned = false;
+			ret = SSL_do_handshake(sess);
+			err = ret > 0 ? SSL_ERROR_NONE : SSL_get_error(sess, ret);
+			selfsigned = SelfSigned;
+		}
+	};
+
+	/** A thread which performs the expensive cryptographic parts of TLS handshakes so that a large
+	 * number of users connecting at once does not stall the main thread.
+	 */
+	class HandshakeThread final
+		: public SocketThread
+	{
+	private:
+		/** Jobs which are waiting to be run by this thread. */
+		std::deque<std::shared_ptr<HandshakeJob>> jobs;
+
+		/** Jobs which have been run by this thread and are waiting to be returned to their hook. */
+		std::vector<std::shared_ptr<HandshakeJob>> results;
+
+		/** Whether this thread has been asked to stop. */
+		bool shutdown = false;
+
+	public:
+		/** Queues a job to be run on this thread. */
+		void Queue(const std::shared_ptr<HandshakeJob>& job)
+		{
+			LockQueue();
+			jobs.push_back(job);
+			UnlockQueueWakeup();
+		}
+
+		/** Stops this thread and finishes any jobs which it had not started on the main thread. */
+		void Finish()
+		{
+			Stop();
+			for (const auto& job : jobs)
+			{
+				job->Run();
+				results.push_back(job);
+			}
+			jobs.clear();
+			OnNotify();
+		}
+
+		void OnStart() override
+		{
+			LockQueue();
+			while (!shutdown)
+			{
+				if (jobs.empty())
+				{
+					WaitForQueue();
+					continue;
+				}
+
+				std::shared_ptr<HandshakeJob> job = jobs.front();
+				jobs.pop_front();
+				UnlockQueue();
+
+				job->Run();
+
+				LockQueue();
+				results.push_back(job);
+				NotifyParent();
+			}
+			UnlockQueue();
+		}
+
+		void OnStop() override
+		{
+			LockQueue();
+			shutdown = true;
+			UnlockQueueWakeup();
+		}
+
+		void OnNotify() override;
+	};
 }
 
+static std::vector<std::unique_ptr<OpenSSL::HandshakeThread>> handshakethreads;
+static size_t nexthandshakethread = 0;
+
 static BIO_METHOD* biomethods;
 
 static int OnVerify(int preverify_ok, X509_STORE_CTX* ctx)
@@ -471,9 +802,149 @@ private:
 	SSL* sess;
 	bool data_to_write = false;
 
+	/** Whether the kernel encrypts data which is written to the socket. */
+	bool ktls_send = false;
+
+	/** The transport underneath the session. */
+	std::shared_ptr<OpenSSL::Transport> transport;
+
+	/** The handshake job which is currently queued on a handshake thread. */
+	std::shared_ptr<OpenSSL::HandshakeJob> handshakejob;
+
+	/** The result of the last staged handshake step. */
+	int stagedret = -1;
+	int stagederr = SSL_ERROR_WANT_READ;
+	bool stagedselfsigned = false;
+
+	// Sends ciphertext which was produced by a staged handshake. Returns false on fatal error.
+	bool FlushTransport(StreamSocket* user)
+	{
+		while (!transport->sendq.empty())
+		{
+			if (user->GetEventMask() & FD_WRITE_WILL_BLOCK)
+				return true;
+
+			ssize_t ret = SocketEngine::Send(user, transport->sendq.data(), transport->sendq.size(), 0);
+			if (ret > 0)
+				transport->sendq.erase(0, ret);
+			else if (SocketEngine::IgnoreError())
+				SocketEngine::ChangeEventMask(user, FD_WRITE_WILL_BLOCK);
+			else
+				return false;
+		}
+		return true;
+	}
+
+	// Receives ciphertext for a staged handshake. Returns false on fatal error.
+	bool ReadTransport(StreamSocket* user)
+	{
+		if (user->GetEventMask() & FD_READ_WILL_BLOCK)
+			return true;
+
+		char* buffer = ServerInstance->GetReadBuffer();
+		size_t bufsiz = ServerInstance->Config->NetBufferSize;
+		ssize_t ret = SocketEngine::Recv(user, buffer, bufsiz, 0);
+		if (ret > 0)
+		{
+			transport->recvq.append(buffer, ret);
+			if (static_cast<size_t>(ret) < bufsiz)
+				SocketEngine::ChangeEventMask(user, FD_READ_WILL_BLOCK);
+			return true;
+		}
+
+		if (ret < 0 && SocketEngine::IgnoreError())
+		{
+			SocketEngine::ChangeEventMask(user, FD_READ_WILL_BLOCK);
+			return true;
+		}
+		return false;
+	}
+
+	// Handshake() for sessions that are driven by the handshake threads.
+	int StagedHandshake(StreamSocket* user)
+	{
+		while (!handshakejob)
+		{
+			if (!FlushTransport(user))
+			{
+				CloseSession();
+				return -1;
+			}
+
+			if (!transport->sendq.empty())
+			{
+				SocketEngine::ChangeEventMask(user, FD_WANT_NO_READ | FD_WANT_SINGLE_WRITE);
+				return 0;
+			}
+
+			if (stagedret > 0)
+			{
+				// Handshake complete.
+				transport->staged = false;
+				SelfSigned = stagedselfsigned;
+				VerifyCertificate();
+				GetProfile().OnHandshakeComplete(sess);
+
+				status = STATUS_OPEN;
+
+				// The peer may have sent application data along with the end of the handshake.
+				int mask = FD_WANT_POLL_READ | FD_WANT_NO_WRITE | FD_ADD_TRIAL_WRITE;
+				if (!transport->recvq.empty())
+					mask |= FD_ADD_TRIAL_READ;
+				SocketEngine::ChangeEventMask(user, mask);
+				return 1;
+			}
+
+			// As the transport never blocks a write OpenSSL only asks for one when it needs to be called again.
+			if (stagedret == 0 || (stagederr != SSL_ERROR_WANT_READ && stagederr != SSL_ERROR_WANT_WRITE))
+			{
+				CloseSession();
+				return -1;
+			}
+
+			if (stagederr == SSL_ERROR_WANT_READ)
+			{
+				if (!ReadTransport(user))
+				{
+					CloseSession();
+					return -1;
+				}
+
+				if (transport->recvq.empty())
+				{
+					SocketEngine::ChangeEventMask(user, FD_WANT_POLL_READ | FD_WANT_NO_WRITE);
+					this->status = STATUS_HANDSHAKING;
+					return 0;
+				}
+			}
+
+			auto job = std::make_shared<OpenSSL::HandshakeJob>(this, sess, transport);
+			if (handshakethreads.empty())
+			{
+				// The handshake threads were stopped whilst this session was being set up.
+				job->Run();
+				stagedret = job->ret;
+				stagederr = job->err;
+				stagedselfsigned = job->selfsigned;
+				continue;
+			}
+
+			// The info callback must not call into this hook from the handshake thread.
+			SSL_set_ex_data(sess, exdataindex, nullptr);
+			handshakejob = job;
+			handshakethreads[nexthandshakethread++ % handshakethreads.size()]->Queue(job);
+		}
+
+		this->status = STATUS_HANDSHAKING;
+		return 0;
+	}
+
 	// Returns 1 if handshake succeeded, 0 if it is still in progress, -1 if it failed
 	int Handshake(StreamSocket* user)
 	{
+		if (transport->staged)
+			return StagedHandshake(user);
+
 		ERR_clear_error();
 		int ret = SSL_do_handshake(sess);
 		if (ret < 0)
@@ -502,6 +973,11 @@ private:
 		{
 			// Handshake complete.
 			VerifyCertificate();
+			GetProfile().OnHandshakeComplete(sess);
+
+			ktls_send = BIO_get_ktls_send(SSL_get_wbio(sess));
+			if (ktls_send)
+				ServerInstance->Logs.Debug(MODNAME, "Session {} is using kernel TLS for outgoing data", fmt::ptr(sess));
 
 			status = STATUS_OPEN;
 
@@ -518,7 +994,13 @@ private:
 
 	void CloseSession()
 	{
-		if (sess)
+		if (handshakejob)
+		{
+			// The session is still in use by a handshake thread so it will be freed when the job returns.
+			handshakejob->hook = nullptr;
+			handshakejob = nullptr;
+		}
+		else if (sess)
 		{
 			SSL_shutdown(sess);
 			SSL_free(sess);
@@ -546,6 +1028,10 @@ private:
 
 		certinfo->invalid = (SSL_get_verify_result(sess) != X509_V_OK);
 
+		// OnVerify is not called when a session is resumed so use the stored result instead.
+		if (SSL_session_reused(sess))
+			SelfSigned = (SSL_get_verify_result(sess) == X509_V_ERR_DEPTH_ZERO_SELF_SIGNED_CERT);
+
 		if (!SelfSigned)
 		{
 			certinfo->unknownsigner = false;
@@ -626,9 +1112,7 @@ private:
 			// The other side is trying to renegotiate, kill the connection and change status
 			// to STATUS_NONE so CheckRenego() closes the session
 			status = STATUS_NONE;
-			BIO* bio = SSL_get_rbio(sess);
-			EventHandler* eh = static_cast<StreamSocket*>(BIO_get_data(bio));
-			SocketEngine::Shutdown(eh, 2);
+			SocketEngine::Shutdown(transport->sock, 2);
 		}
 	}
 
@@ -643,6 +1127,58 @@ private:
 		return false;
 	}
 
+	// Writes the sendq directly to the socket when the kernel is encrypting it for us.
+	ssize_t KernelTLSWrite(StreamSocket* user, StreamSocket::SendQueue& sendq)
+	{
+		while (!sendq.empty())
+		{
+			if (user->GetEventMask() & FD_WRITE_WILL_BLOCK)
+			{
+				SocketEngine::ChangeEventMask(user, FD_WANT_SINGLE_WRITE);
+				return 0;
+			}
+
+			SocketEngine::IOVector iovecs[64];
+			int count = 0;
+			for (auto it = sendq.begin(); it != sendq.end() && count < static_cast<int>(std::size(iovecs)); ++it, ++count)
+			{
+				iovecs[count].iov_base = const_cast<char*>(it->data());
+				iovecs[count].iov_len = it->length();
+			}
+
+			ssize_t ret = SocketEngine::WriteV(user, iovecs, count);
+			if (ret > 0)
+			{
+				while (ret > 0 && !sendq.empty())
+				{
+					const size_t len = std::min<size_t>(ret, sendq.front().length());
+					if (len == sendq.front().length())
+						sendq.pop_front();
+					else
+						sendq.erase_front(len);
+					ret -= len;
+				}
+			}
+			else if (ret < 0 && SocketEngine::IgnoreError())
+			{
+				SocketEngine::ChangeEventMask(user, FD_WANT_SINGLE_WRITE | FD_WRITE_WILL_BLOCK);
+				return 0;
+			}
+			else if (ret < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			else
+			{
+				CloseSession();
+				return -1;
+			}
+		}
+
+		SocketEngine::ChangeEventMask(user, FD_WANT_POLL_READ | FD_WANT_NO_WRITE);
+		return 1;
+	}
+
 	// Returns 1 if application I/O should proceed, 0 if it must wait for the underlying protocol to progress, -1 on fatal error
 	int PrepareIO(StreamSocket* sock)
 	{
@@ -665,17 +1201,44 @@ public:
 	OpenSSLIOHook(const std::shared_ptr<IOHookProvider>& hookprov, StreamSocket* sock, SSL* session)
 		: SSLIOHook(hookprov)
 		, sess(session)
+		, transport(std::make_shared<OpenSSL::Transport>(sock))
 	{
-		// Create BIO instance and store a pointer to the socket in it which will be used by the read and write functions
+		// Create BIO instance and store a pointer to the transport in it which will be used by the read and write functions
 		BIO* bio = BIO_new(biomethods);
-		BIO_set_data(bio, sock);
-		SSL_set_bio(sess, bio, bio);
+		BIO_set_data(bio, transport.get());
+		if (GetProfile().UseKernelTLS())
+		{
+			// OpenSSL can only pass the session keys to the kernel when it is writing to the socket itself.
+			SSL_set_bio(sess, bio, BIO_new_socket(sock->GetFd(), BIO_NOCLOSE));
+		}
+		else
+			SSL_set_bio(sess, bio, bio);
 
 		SSL_set_ex_data(sess, exdataindex, this);
 		sock->AddIOHook(this);
+
+		if (!handshakethreads.empty() && !GetProfile().UseKernelTLS())
+		{
+			// Clients have to speak first so they need to run the handshake before reading anything.
+			transport->staged = true;
+			stagederr = SSL_is_server(sess) ? SSL_ERROR_WANT_READ : SSL_ERROR_WANT_WRITE;
+		}
 		Handshake(sock);
 	}
 
+	/** Called when a handshake thread has finished running a step of the handshake. */
+	void OnHandshakeDone(const OpenSSL::HandshakeJob& job)
+	{
+		handshakejob = nullptr;
+		stagedret = job.ret;
+		stagederr = job.err;
+		stagedselfsigned = job.selfsigned;
+		SSL_set_ex_data(sess, exdataindex, this);
+
+		// Continue the handshake from the socket so that errors are handled in the usual way.
+		transport->sock->OnEventHandlerRead();
+	}
+
 	void OnStreamSocketClose(StreamSocket* user) override
 	{
 		CloseSession();
@@ -748,6 +1311,9 @@ public:
 		if (prepret <= 0)
 			return prepret;
 
+		if (ktls_send)
+			return KernelTLSWrite(user, sendq);
+
 		data_to_write = true;
 
 		// Session is ready for transferring application data
@@ -814,6 +1380,9 @@ public:
 
 	bool GetServerName(std::string& out) const override
 	{
+		if (handshakejob)
+			return false;
+
 		const char* name = SSL_get_servername(sess, TLSEXT_NAMETYPE_host_name);
 		if (!name)
 			return false;
@@ -828,14 +1397,45 @@ public:
 static void StaticSSLInfoCallback(const SSL* ssl, int where, int rc)
 {
 	OpenSSLIOHook* hook = static_cast<OpenSSLIOHook*>(SSL_get_ex_data(ssl, exdataindex));
-	hook->SSLInfoCallback(where, rc);
+	if (hook)
+		hook->SSLInfoCallback(where, rc);
+}
+
+static int StaticTicketKeyCallback(SSL* ssl, unsigned char* keyname, unsigned char* iv, EVP_CIPHER_CTX* cctx, EVP_MAC_CTX* hctx, int enc)
+{
+	auto* keys = static_cast<OpenSSL::TicketKeys*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ctxexdataindex));
+	return keys ? keys->OnTicket(keyname, iv, cctx, hctx, enc) : -1;
+}
+
+void OpenSSL::HandshakeThread::OnNotify()
+{
+	LockQueue();
+	std::vector<std::shared_ptr<HandshakeJob>> done;
+	done.swap(results);
+	UnlockQueue();
+
+	for (const auto& job : done)
+	{
+		if (job->hook)
+			job->hook->OnHandshakeDone(*job);
+		else
+			SSL_free(job->sess);
+	}
 }
 
 static int OpenSSL::BIOMethod::write(BIO* bio, const char* buffer, int size)
 {
 	BIO_clear_retry_flags(bio);
 
-	StreamSocket* sock = static_cast<StreamSocket*>(BIO_get_data(bio));
+	OpenSSL::Transport* transport = static_cast<OpenSSL::Transport*>(BIO_get_data(bio));
+	if (transport->staged)
+	{
+		// The socket belongs to the main thread so buffer the data until it can be sent.
+		transport->sendq.append(buffer, size);
+		return size;
+	}
+
+	StreamSocket* sock = transport->sock;
 	if (sock->GetEventMask() & FD_WRITE_WILL_BLOCK)
 	{
 		// Writes blocked earlier, don't retry syscall
@@ -858,7 +1458,23 @@ static int OpenSSL::BIOMethod::read(BIO* bio, char* buffer, int size)
 {
 	BIO_clear_retry_flags(bio);
 
-	StreamSocket* sock = static_cast<StreamSocket*>(BIO_get_data(bio));
+	OpenSSL::Transport* transport = static_cast<OpenSSL::Transport*>(BIO_get_data(bio));
+	if (!transport->recvq.empty())
+	{
+		// Consume data which was received whilst the handshake was staged first.
+		const int ret = static_cast<int>(std::min<size_t>(size, transport->recvq.size()));
+		memcpy(buffer, transport->recvq.data(), ret);
+		transport->recvq.erase(0, ret);
+		return ret;
+	}
+
+	if (transport->staged)
+	{
+		BIO_set_retry_read(bio);
+		return -1;
+	}
+
+	StreamSocket* sock = transport->sock;
 	if (sock->GetEventMask() & FD_READ_WILL_BLOCK)
 	{
 		// Reads blocked earlier, don't retry syscall
@@ -915,6 +1531,7 @@ OpenSSL::Profile& OpenSSLIOHook::GetProfile()
 
 class ModuleSSLOpenSSL final
 	: public Module
+	, public Stats::EventListener
 {
 	typedef std::vector<std::shared_ptr<OpenSSLIOHookProvider>> ProfileList;
 
@@ -942,17 +1559,17 @@ class ModuleSSLOpenSSL final
 				continue;
 			}
 
-			std::shared_ptr<OpenSSLIOHookProvider> prov;
+			std::shared_ptr<OpenSSLIOHookProvider> hookprov;
 			try
 			{
-				prov = std::make_shared<OpenSSLIOHookProvider>(this, name, tag);
+				hookprov = std::make_shared<OpenSSLIOHookProvider>(this, name, tag);
 			}
 			catch (const CoreException& ex)
 			{
 				throw ModuleException(this, "Error while initializing TLS profile \"" + name + "\" at " + tag->source.str() + " - " + ex.GetReason());
 			}
 
-			newprofiles.push_back(prov);
+			newprofiles.push_back(hookprov);
 		}
 
 		for (const auto& profile : profiles)
@@ -961,9 +1578,27 @@ class ModuleSSLOpenSSL final
 		profiles.swap(newprofiles);
 	}
 
+	void SetHandshakeThreads(size_t count)
+	{
+		if (count == handshakethreads.size())
+			return;
+
+		for (const auto& thread : handshakethreads)
+			thread->Finish();
+		handshakethreads.clear();
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto thread = std::make_unique<OpenSSL::HandshakeThread>();
+			thread->Start();
+			handshakethreads.push_back(std::move(thread));
+		}
+	}
+
 public:
 	ModuleSSLOpenSSL()
 		: Module(VF_VENDOR, "Allows TLS encrypted connections using the OpenSSL library.")
+		, Stats::EventListener(this)
 	{
 		// Initialize OpenSSL
 		OPENSSL_init_ssl(0, nullptr);
@@ -974,6 +1609,7 @@ public:
 
 	~ModuleSSLOpenSSL() override
 	{
+		SetHandshakeThreads(0);
 		BIO_meth_free(biomethods);
 	}
 
@@ -987,11 +1623,16 @@ public:
 		exdataindex = SSL_get_ex_new_index(0, exdatastr, nullptr, nullptr, nullptr);
 		if (exdataindex < 0)
 			throw ModuleException(this, "Failed to register application specific data");
+
+		ctxexdataindex = SSL_CTX_get_ex_new_index(0, exdatastr, nullptr, nullptr, nullptr);
+		if (ctxexdataindex < 0)
+			throw ModuleException(this, "Failed to register application specific data");
 	}
 
 	void ReadConfig(ConfigStatus& status) override
 	{
 		const auto& tag = ServerInstance->Config->ConfValue("openssl");
+		SetHandshakeThreads(tag->getNum<size_t>("handshakethreads", 0, 0, 64));
 		if (status.initial || tag->getBool("onrehash", true))
 		{
 			// Try to help people who have outdated configs.
@@ -1035,6 +1676,16 @@ public:
 		}
 	}
 
+	ModResult OnStats(Stats::Context& stats) override
+	{
+		if (stats.GetSymbol() != 't')
+			return MOD_RES_PASSTHRU;
+
+		for (const auto& profile : profiles)
+			profile->GetProfile().GetStats(stats);
+		return MOD_RES_DENY;
+	}
+
 	ModResult OnCheckReady(LocalUser* user) override
 	{
 		const OpenSSLIOHook* const iohook = static_cast<OpenSSLIOHook*>(user->eh.GetModHook(this));
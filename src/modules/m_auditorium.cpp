@@ -141,10 +141,10 @@ public:
 		if (IsVisible(memb))
 			return;
 
-		for (const auto& [user, _] : memb->chan->GetUsers())
+		for (const auto* localmemb : memb->chan->GetLocalUsers())
 		{
-			if (IS_LOCAL(user) && !CanSee(user, memb))
-				excepts.insert(user);
+			if (!CanSee(localmemb->user, memb))
+				excepts.insert(localmemb->user);
 		}
 	}
 
@@ -172,10 +172,10 @@ public:
 			// this channel should not be considered when listing my neighbors
 			i = include.erase(i);
 			// however, that might hide me from ops that can see me...
-			for (const auto& [user, _] : memb->chan->GetUsers())
+			for (const auto* localmemb : memb->chan->GetLocalUsers())
 			{
-				if (IS_LOCAL(user) && CanSee(user, memb))
-					exception[user] = true;
+				if (CanSee(localmemb->user, memb))
+					exception[localmemb->user] = true;
 			}
 		}
 	}
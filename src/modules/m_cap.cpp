@@ -216,7 +216,7 @@ public:
 
 	void Set302Protocol(LocalUser* user)
 	{
-		capext.Set(user, capext.Get(user) | CAP_302_BIT);
+		capext.SetCaps(user, capext.Get(user) | CAP_302_BIT);
 	}
 
 	bool HandleReq(LocalUser* user, const std::string& reqlist)
@@ -239,7 +239,7 @@ public:
 				usercaps = cap->AddToMask(usercaps);
 		}
 
-		capext.Set(user, usercaps);
+		capext.SetCaps(user, usercaps);
 		return true;
 	}
 
@@ -276,7 +276,7 @@ public:
 	void HandleClear(LocalUser* user, std::vector<std::string>& result)
 	{
 		HandleList(result, user, false, false, true);
-		capext.Unset(user);
+		capext.SetCaps(user, 0);
 	}
 };
 
@@ -318,6 +318,14 @@ Cap::ExtItem::ExtItem(Module* mod)
 {
 }
 
+void Cap::ExtItem::Delete(Extensible* container, void* item)
+{
+	// The caps are going away so the profile has to as well.
+	LocalUser* user = IS_LOCAL(static_cast<User*>(container));
+	if (user)
+		user->capprofile = 0;
+}
+
 std::string Cap::ExtItem::ToHuman(const Extensible* container, void* item) const noexcept
 {
 	return SerializeCaps(container, true);
@@ -425,6 +433,8 @@ public:
 		else if (irc::equals(subcommand, "END"))
 		{
 			holdext.Unset(user);
+			if (user->connected == User::CONN_NICKUSER)
+				user->ScheduleHousekeeping(ServerInstance->Time());
 		}
 		else if (irc::equals(subcommand, "LS") || irc::equals(subcommand, "LIST"))
 		{
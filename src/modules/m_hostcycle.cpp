@@ -70,10 +70,10 @@ class ModuleHostCycle final
 			Channel* c = memb->chan;
 			ClientProtocol::Events::Join joinevent(memb, newfullhost);
 
-			for (const auto& [chanuser, _] : c->GetUsers())
+			for (const auto* chanmemb : c->GetLocalUsers())
 			{
-				LocalUser* u = IS_LOCAL(chanuser);
-				if (!u || u == user)
+				LocalUser* u = static_cast<LocalUser*>(chanmemb->user);
+				if (u == user)
 					continue;
 				if (u->already_sent == silent_id)
 					continue;
@@ -179,6 +179,32 @@ namespace Stats
 		serializer.EndBlock();
 	}
 
+	void MainLoop(XMLSerializer& serializer)
+	{
+		const auto histogram = [&serializer](const char* name, const insp::histogram& hist) {
+			serializer.BeginBlock("timing")
+				.Attribute("name", name)
+				.Attribute("count", hist.count())
+				.Attribute("p50", hist.percentile(50))
+				.Attribute("p90", hist.percentile(90))
+				.Attribute("p99", hist.percentile(99))
+				.Attribute("p999", hist.percentile(99.9))
+				.Attribute("max", hist.max())
+				.EndBlock();
+		};
+
+		// All main loop timings are in nanoseconds.
+		const MainLoopStats& loopstats = ServerInstance->LoopStats;
+		serializer.BeginBlock("mainloop")
+			.Attribute("resettime", loopstats.GetLastReset());
+		for (uint8_t phase = 0; phase < MainLoopStats::PHASE_END; ++phase)
+			histogram(MainLoopStats::GetPhaseName(static_cast<MainLoopStats::Phase>(phase)), loopstats.GetPhase(static_cast<MainLoopStats::Phase>(phase)));
+		histogram("iteration", loopstats.GetIterations());
+		histogram("busy", loopstats.GetBusy());
+		histogram("eventsperwakeup", SocketEngine::GetStats().EventsPerWakeup);
+		serializer.EndBlock();
+	}
+
 	void XLines(XMLSerializer& serializer)
 	{
 		serializer.BeginBlock("xlines");
@@ -330,6 +356,8 @@ namespace Stats
 			serializer.BeginBlock("command")
 				.Attribute("name", cmdname)
 				.Attribute("usecount", cmd->use_count)
+				.Attribute("usetime", cmd->use_time)
+				.Attribute("useoutput", cmd->use_output)
 				.EndBlock();
 		}
 		serializer.EndBlock();
@@ -473,6 +501,7 @@ public:
 		{
 			Stats::ServerInfo(serializer);
 			Stats::General(serializer);
+			Stats::MainLoop(serializer);
 			Stats::XLines(serializer);
 			Stats::Modules(serializer);
 			Stats::Channels(serializer);
@@ -484,6 +513,10 @@ public:
 		{
 			Stats::General(serializer);
 		}
+		else if (request.GetPath() == "/stats/mainloop")
+		{
+			Stats::MainLoop(serializer);
+		}
 		else if (request.GetPath() == "/stats/users")
 		{
 			Stats::ListUsers(serializer, request.GetParsedURI().query_params);
@@ -95,7 +95,7 @@ public:
 		{
 			for (const auto& entry : *list)
 			{
-				if (chan->CheckBan(user, entry.mask))
+				if (chan->CheckBan(user, entry.GetCompiledBan()))
 				{
 					return MOD_RES_ALLOW;
 				}
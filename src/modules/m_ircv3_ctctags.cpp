@@ -87,12 +87,12 @@ private:
 		CTCTags::TagMessage message(source, chan, msgdetails.tags_out, msgtarget.status);
 		message.SetSideEffect(true);
 
-		for (const auto& [user, memb] : chan->GetUsers())
+		for (const auto* memb : chan->GetLocalUsers())
 		{
-			LocalUser* luser = IS_LOCAL(user);
+			LocalUser* luser = static_cast<LocalUser*>(memb->user);
 
-			// Don't send to remote users or the user who is the source.
-			if (!luser || luser == source)
+			// Don't send to the user who is the source.
+			if (luser == source)
 				continue;
 
 			// Don't send to unprivileged or exempt users.
@@ -313,6 +313,11 @@ public:
 	{
 		return cap.IsEnabled(user);
 	}
+
+	bool IsCapabilityBased() const override
+	{
+		return true;
+	}
 };
 
 class ModuleIRCv3CTCTags final
@@ -38,21 +38,22 @@ public:
 	{
 		ClientProtocol::Messages::Invite invitemsg(source, dest, chan);
 		ClientProtocol::Event inviteevent(ServerInstance->GetRFCEvents().invite, invitemsg);
-		for (const auto& [user, memb] : chan->GetUsers())
+		for (const auto* memb : chan->GetLocalUsers())
 		{
+			// Caps are only set on local users
+			LocalUser* const localuser = static_cast<LocalUser*>(memb->user);
+
 			// Skip members who don't use this extension or were excluded by other modules
-			if ((!cap.IsEnabled(user)) || (notifyexcepts.count(user)))
+			if ((!cap.IsEnabled(localuser)) || (notifyexcepts.count(localuser)))
 				continue;
 
 			// Check whether the member has a high enough rank to see the notification
 			if (memb->GetRank() < notifyrank)
 				continue;
 
-			// Caps are only set on local users
-			LocalUser* const localuser = static_cast<LocalUser*>(user);
 			// Send and add the user to the exceptions so they won't get the NOTICE invite announcement message
 			localuser->Send(inviteevent);
-			notifyexcepts.insert(user);
+			notifyexcepts.insert(localuser);
 		}
 	}
 
@@ -211,7 +211,7 @@ public:
 			Modes::ChangeList changelist;
 			for (const auto& entry : *list)
 			{
-				if (c->CheckBan(u, entry.mask))
+				if (c->CheckBan(u, entry.GetCompiledBan()))
 					changelist.push(mh, false, entry.mask);
 			}
 			ServerInstance->Modes.Process(user, c, nullptr, changelist);
@@ -73,7 +73,7 @@ CmdResult CommandAddLine::Handle(User* usr, Params& params)
 
 		if (!remoteserver->IsBursting())
 		{
-			ServerInstance->XLines->ApplyLines();
+			ServerInstance->XLines->QueueApplyLines();
 		}
 		return CmdResult::SUCCESS;
 	}
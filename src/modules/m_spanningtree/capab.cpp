@@ -395,6 +395,17 @@ void TreeSocket::SendCapabilities(int phase)
 		capabilities["CHALLENGE"] = GetOurChallenge();
 	}
 
+	// If we have been asked to compress the link and are able to then tell the remote server.
+	if (FindCompression(capab->compress))
+		capabilities["COMPRESSION"] = capab->compress;
+
+	// If we can resume the link if it is lost then send a token to identify it.
+	if (Utils->ResumeWindow)
+	{
+		capab->resumetoken = ServerInstance->GenRandomStr(16);
+		capabilities["RESUME"] = capab->resumetoken;
+	}
+
 	std::stringstream capabilitystr;
 	char separator = ':';
 	for (const auto& [capkey, capvalue] : capabilities)
@@ -583,6 +594,8 @@ bool TreeSocket::Capab(const CommandBase::Params& params)
 					ServerInstance->Config->ServerId,
 					ServerInstance->Config->ServerDesc
 				));
+				this->StartCompressing();
+				this->StartJournal();
 			}
 		}
 		else
@@ -598,6 +611,8 @@ bool TreeSocket::Capab(const CommandBase::Params& params)
 					ServerInstance->Config->ServerId,
 					ServerInstance->Config->ServerDesc
 				));
+				this->StartCompressing();
+				this->StartJournal();
 			}
 		}
 	}
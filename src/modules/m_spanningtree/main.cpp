@@ -176,7 +176,10 @@ void ModuleSpanningTree::ConnectServer(const std::shared_ptr<Autoconnect>& a, bo
 		return;
 	for(unsigned int j=0; j < a->servers.size(); j++)
 	{
-		if (Utils->FindServer(a->servers[j]))
+		// If we are holding the state of a server which we should reconnect
+		// to then it counts as not being connected.
+		TreeServer* const server = Utils->FindServer(a->servers[j]);
+		if (server && !(server->IsLocal() && server->GetSocket()->ShouldReconnect()))
 		{
 			// found something in this block. Should the server fail,
 			// we want to start at the start of the list, not in the
@@ -789,7 +792,7 @@ restart:
 		TreeSocket* sock = child->GetSocket();
 		if (sock->GetModHook(mod))
 		{
-			sock->SendError("TLS module unloaded");
+			sock->SendError("I/O hook module unloaded");
 			sock->Close();
 			// XXX: The list we're iterating is modified by TreeServer::SQuit() which is called by Close()
 			goto restart;
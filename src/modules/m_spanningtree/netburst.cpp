@@ -109,19 +109,103 @@ void TreeSocket::DoBurst(TreeServer* s)
 	// Introduce all servers behind us
 	this->SendServers(Utils->TreeRoot, s);
 
+	// Users and channels are sent as the link drains so that a large netburst
+	// does not have to be held in memory. The servers above are always sent
+	// immediately as users and messages which are routed to this server while
+	// the netburst is being sent may depend on them.
+	burst = std::make_unique<BurstProgress>();
+	burst->users.reserve(ServerInstance->Users.GetUsers().size());
+	for (const auto& [_, user] : ServerInstance->Users.GetUsers())
+	{
+		if (user->IsFullyConnected())
+			burst->users.push_back(user->uuid);
+	}
+
+	burst->channels.reserve(ServerInstance->Channels.GetChans().size());
+	for (const auto& [name, _] : ServerInstance->Channels.GetChans())
+		burst->channels.push_back(name);
+
+	ContinueBurst();
+}
+
+void TreeSocket::ContinueBurst()
+{
 	BurstState bs(this);
-	// Introduce all users
-	this->SendUsers(bs);
-
-	// Sync all channels
-	for (const auto& [_, chan] : ServerInstance->Channels.GetChans())
-		SyncChannel(chan, bs);
-
-	// Send all xlines
-	this->SendXLines();
-	Utils->Creator->synceventprov.Call(&ServerProtocol::SyncEventListener::OnSyncNetwork, bs.server);
-	this->WriteLine(CmdBuilder("ENDBURST"));
-	ServerInstance->SNO.WriteToSnoMask('l', "Finished bursting to \002"+ s->GetName()+"\002.");
+	while (burst)
+	{
+		// Wait for the link to catch up before sending any more.
+		if (Utils->BurstSendQ && GetSendQSize() >= Utils->BurstSendQ)
+			return;
+
+		switch (burst->stage)
+		{
+			case BurstProgress::STAGE_USERS:
+			{
+				if (burst->position >= burst->users.size())
+				{
+					burst->stage = BurstProgress::STAGE_CHANNELS;
+					burst->position = 0;
+					break;
+				}
+
+				// Users which quit since the netburst started have already had
+				// their QUIT sent to the server and can be skipped.
+				auto* user = ServerInstance->Users.FindUUID(burst->users[burst->position++]);
+				if (user && !user->quitting)
+					SendUser(user, bs);
+				break;
+			}
+
+			case BurstProgress::STAGE_CHANNELS:
+			{
+				if (burst->position >= burst->channels.size())
+				{
+					burst->stage = BurstProgress::STAGE_FINISH;
+					break;
+				}
+
+				// Channels which were created after the netburst started have
+				// been sent to the server as their users joined them.
+				auto* chan = ServerInstance->Channels.Find(burst->channels[burst->position++]);
+				if (chan)
+					SyncChannel(chan, bs);
+				break;
+			}
+
+			case BurstProgress::STAGE_FINISH:
+			{
+				burst.reset();
+
+				// Send all xlines
+				this->SendXLines();
+				Utils->Creator->synceventprov.Call(&ServerProtocol::SyncEventListener::OnSyncNetwork, bs.server);
+				this->WriteLine(CmdBuilder("ENDBURST"));
+				ServerInstance->SNO.WriteToSnoMask('l', "Finished bursting to \002"+ MyRoot->GetName()+"\002.");
+				break;
+			}
+		}
+	}
+}
+
+void TreeSocket::OnEventHandlerWrite()
+{
+	this->BufferedSocket::OnEventHandlerWrite();
+	if (!burst || !GetError().empty() || SocketEngine::IsDeferringWrites())
+		return;
+
+	ContinueBurst();
+	this->BufferedSocket::OnEventHandlerWrite();
+
+	// If the link took everything we sent then the socket engine will not tell
+	// us when it is writable again so we have to pick up from here ourselves.
+	if (burst && GetError().empty() && GetSendQSize() < Utils->BurstSendQ)
+		bursttimer.SetIntervalMillis(0);
+}
+
+bool TreeSocket::BurstTimer::Tick()
+{
+	sock->OnEventHandlerWrite();
+	return true;
 }
 
 void TreeSocket::SendServerInfo(TreeServer* from)
@@ -274,32 +358,26 @@ void TreeSocket::SyncChannel(Channel* chan)
 	SyncChannel(chan, bs);
 }
 
-/** Send all users and their state, including oper and away status and global metadata */
-void TreeSocket::SendUsers(BurstState& bs)
+/** Send a user and their state, including oper and away status and global metadata */
+void TreeSocket::SendUser(User* user, BurstState& bs)
 {
-	for (const auto& [_, user] : ServerInstance->Users.GetUsers())
-	{
-		if (!user->IsFullyConnected())
-			continue;
+	this->WriteLine(CommandUID::Builder(user, this->proto_version != PROTO_INSPIRCD_3));
 
-		this->WriteLine(CommandUID::Builder(user, this->proto_version != PROTO_INSPIRCD_3));
+	if (user->IsOper())
+		this->WriteLine(CommandOpertype::Builder(user, user->oper));
 
-		if (user->IsOper())
-			this->WriteLine(CommandOpertype::Builder(user, user->oper));
+	if (user->IsAway())
+		this->WriteLine(CommandAway::Builder(user));
 
-		if (user->IsAway())
-			this->WriteLine(CommandAway::Builder(user));
+	if (user->uniqueusername) // TODO: convert this to BooleanExtItem.
+		this->WriteLine(CommandMetadata::Builder(user, "uniqueusername", "1"));
 
-		if (user->uniqueusername) // TODO: convert this to BooleanExtItem.
-			this->WriteLine(CommandMetadata::Builder(user, "uniqueusername", "1"));
-
-		for (const auto& [item, obj] : user->GetExtList())
-		{
-			const std::string value = item->ToNetwork(user, obj);
-			if (!value.empty())
-				this->WriteLine(CommandMetadata::Builder(user, item->name, value));
-		}
-
-		Utils->Creator->synceventprov.Call(&ServerProtocol::SyncEventListener::OnSyncUser, user, bs.server);
+	for (const auto& [item, obj] : user->GetExtList())
+	{
+		const std::string value = item->ToNetwork(user, obj);
+		if (!value.empty())
+			this->WriteLine(CommandMetadata::Builder(user, item->name, value));
 	}
+
+	Utils->Creator->synceventprov.Call(&ServerProtocol::SyncEventListener::OnSyncUser, user, bs.server);
 }
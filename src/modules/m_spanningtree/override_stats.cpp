@@ -22,10 +22,13 @@
 
 
 #include "inspircd.h"
+#include "modules/compress.h"
 
 #include "main.h"
 #include "utils.h"
 #include "link.h"
+#include "treeserver.h"
+#include "treesocket.h"
 
 ModResult ModuleSpanningTree::OnStats(Stats::Context& stats)
 {
@@ -56,5 +59,25 @@ ModResult ModuleSpanningTree::OnStats(Stats::Context& stats)
 		}
 		return MOD_RES_DENY;
 	}
+	else if (stats.GetSymbol() == 'x')
+	{
+		for (const auto* child : Utils->TreeRoot->GetChildren())
+		{
+			const CompressIOHook* const hook = CompressIOHook::IsCompressed(child->GetSocket());
+			if (!hook)
+				continue;
+
+			const CompressIOHook::Stats& cstats = hook->GetStats();
+			const auto ratio = [](uint64_t compressed, uint64_t raw) {
+				return raw ? compressed * 100.0 / raw : 100.0;
+			};
+			stats.AddGenericRow(fmt::format("The link to {} is compressed with {}: sent {} bytes as {} ({:.1f}%), received {} bytes as {} ({:.1f}%), {} microseconds spent (de)compressing",
+				child->GetName(), hook->prov->name.substr(hook->prov->name.find('/') + 1),
+				cstats.raw_out, cstats.compressed_out, ratio(cstats.compressed_out, cstats.raw_out),
+				cstats.raw_in, cstats.compressed_in, ratio(cstats.compressed_in, cstats.raw_in),
+				std::chrono::duration_cast<std::chrono::microseconds>(cstats.time).count()));
+		}
+		return MOD_RES_DENY;
+	}
 	return MOD_RES_PASSTHRU;
 }
@@ -56,7 +56,12 @@ PingTimer::State PingTimer::TickInternal()
 		// They didn't answer the last ping, if they are locally connected, get rid of them
 		if (server->IsLocal())
 		{
+			// The hold timer decides when to give up on a server which is
+			// expected to resume the link.
 			TreeSocket* sock = server->GetSocket();
+			if (sock->GetLinkState() == HELD)
+				return PS_TIMEOUT;
+
 			sock->SendError("Ping timeout");
 			sock->Close();
 		}
@@ -0,0 +1,200 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "inspircd.h"
+#include "timeutils.h"
+
+#include "main.h"
+#include "utils.h"
+#include "link.h"
+#include "treeserver.h"
+#include "treesocket.h"
+
+/*
+ * Resuming a link works like this:
+ *
+ * 1. Both servers send RESUME=<token> in CAPAB CAPABILITIES. Once they have
+ *    sent their SERVER line each keeps a journal of the lines it sends and
+ *    counts the lines it processes from the other.
+ * 2. If the connection is lost because of an error the state of the server
+ *    is held for <options:resumewindow> instead of splitting it. Anything
+ *    which would have been sent to it is added to the journal.
+ * 3. The server which initiated the connection reconnects. When it receives
+ *    the SERVER line of the other server it sends RESUME <token> <received>
+ *    <first> instead of a netburst where <received> is the number of lines it
+ *    processed and <first> is the number of the oldest line in its journal.
+ * 4. If the other server can replay the lines after <received> and still has
+ *    the state of the server it replies with RESUME <token> <received> and
+ *    replays them. Otherwise, it replies with RESUME and waits for a netburst.
+ * 5. When the initiator receives the reply it either replays the lines after
+ *    <received> or splits the server and sends a netburst.
+ */
+
+void TreeSocket::StartJournal()
+{
+	// Both servers have to be able to resume the link. Older servers never are.
+	const auto it = capab->CapKeys.find("RESUME");
+	if (capab->resumetoken.empty() || it == capab->CapKeys.end() || it->second.empty())
+		return;
+
+	// Both servers derive the same token from the ones they sent.
+	const std::string& ours = capab->resumetoken;
+	const std::string& theirs = it->second;
+	journal = std::make_unique<ResumeJournal>(ours < theirs ? ours + theirs : theirs + ours, LinkState == CONNECTING);
+}
+
+bool TreeSocket::Hold()
+{
+	// Links can only be resumed once they have been established and the netburst sent.
+	if (!journal || !Utils->ResumeWindow || burst || !MyRoot || MyRoot->IsDead() || Utils->Creator->dying)
+		return false;
+
+	this->BufferedSocket::Close();
+	LinkState = HELD;
+	holdtimer.SetInterval(Utils->ResumeWindow);
+
+	ServerInstance->SNO.WriteGlobalSno('l', "Holding the state of \002{}\002 for up to {} while waiting for it to resume the link.",
+		linkID, Duration::ToString(Utils->ResumeWindow));
+
+	// Don't wait for the autoconnect to notice that the server has gone.
+	if (journal->outbound)
+	{
+		std::shared_ptr<Link> link = Utils->FindLink(linkID);
+		if (link)
+			Utils->Creator->ConnectServer(link);
+	}
+	return true;
+}
+
+bool TreeSocket::HoldTimer::Tick()
+{
+	ServerInstance->SNO.WriteGlobalSno('l', "\002{}\002 did not resume the link in time.", sock->linkID);
+	sock->Close();
+	return true;
+}
+
+TreeSocket* TreeSocket::FindHeld(const std::string& remotename, const std::string& remotesid)
+{
+	TreeServer* server = Utils->FindServer(remotename);
+	if (!server || !server->IsLocal() || server->GetId() != remotesid)
+		return nullptr;
+
+	TreeSocket* sock = server->GetSocket();
+	return sock->LinkState == HELD ? sock : nullptr;
+}
+
+bool TreeSocket::ReleaseHeld(const std::string& remotename, const std::string& remotesid, bool resumable)
+{
+	if (resumable && FindHeld(remotename, remotesid))
+		return true;
+
+	const auto release = [](TreeServer* server)
+	{
+		if (!server || server->IsRoot())
+			return;
+
+		TreeSocket* sock = server->GetRoute()->GetSocket();
+		if (sock->LinkState == HELD)
+			sock->Close();
+	};
+
+	// Servers which split are removed from the lookup tables so we have to look
+	// up the second server after releasing the first one.
+	release(Utils->FindServer(remotename));
+	release(Utils->FindServerID(remotesid));
+	return false;
+}
+
+void TreeSocket::Resume(TreeSocket* held, uint64_t from)
+{
+	MyRoot = held->MyRoot;
+	MyRoot->SetSocket(this);
+	linkID = held->linkID;
+	held->MyRoot = nullptr;
+
+	// The lines being replayed are already in the journal so they must not be
+	// added to it again.
+	std::unique_ptr<ResumeJournal> replay = std::move(held->journal);
+	held->LinkState = DYING;
+	ServerInstance->GlobalCulls.AddItem(held);
+
+	this->LinkState = CONNECTED;
+	Utils->timeoutlist.erase(this);
+	CleanNegotiationInfo();
+
+	journal.reset();
+	const auto& lines = replay->lines;
+	for (auto it = lines.begin() + (from - replay->GetFirst()); it != lines.end(); ++it)
+		WriteLineInternal(*it);
+	journal = std::move(replay);
+
+	const uint64_t replayed = journal->sent - from;
+	ServerInstance->SNO.WriteGlobalSno('l', "Resumed the link to \002{}\002 and replayed {} line{}.",
+		linkID, replayed, replayed != 1 ? "s" : "");
+}
+
+void TreeSocket::Inbound_Resume(CommandBase::Params& params)
+{
+	TreeSocket* held = FindHeld(capab->name, capab->sid);
+	if (held && params.size() >= 3 && params[0] == held->journal->token)
+	{
+		// We have to be able to replay what they missed and they have to be
+		// able to replay what we missed.
+		const uint64_t theirreceived = ConvToNum<uint64_t>(params[1]);
+		const uint64_t theirfirst = ConvToNum<uint64_t>(params[2]);
+		if (held->journal->CanReplay(theirreceived) && held->journal->received >= theirfirst)
+		{
+			WriteLine(fmt::format("RESUME {} {}", params[0], held->journal->received));
+			Resume(held, theirreceived);
+			return;
+		}
+	}
+
+	ServerInstance->SNO.WriteGlobalSno('l', "Unable to resume the link to \002{}\002, waiting for a netburst.", capab->name);
+	WriteLine("RESUME");
+	ReleaseHeld(capab->name, capab->sid);
+}
+
+void TreeSocket::Outbound_Reply_Resume(CommandBase::Params& params)
+{
+	if (capab->name.empty())
+	{
+		SendError("Received RESUME without asking to resume the link");
+		return;
+	}
+
+	if (params.empty())
+	{
+		// They are not able to resume the link so we have to send a netburst.
+		ServerInstance->SNO.WriteGlobalSno('l', "Unable to resume the link to \002{}\002, sending a netburst.", capab->name);
+		ReleaseHeld(capab->name, capab->sid);
+		FinishAuth(capab->name, capab->sid, capab->description, capab->hidden);
+		return;
+	}
+
+	// They have already resumed the link so if we can't then it has to split.
+	TreeSocket* held = FindHeld(capab->name, capab->sid);
+	const uint64_t theirreceived = params.size() >= 2 ? ConvToNum<uint64_t>(params[1]) : 0;
+	if (!held || params.size() < 2 || params[0] != held->journal->token || !held->journal->CanReplay(theirreceived))
+	{
+		ReleaseHeld(capab->name, capab->sid);
+		SendError("Unable to resume the link");
+		return;
+	}
+
+	Resume(held, theirreceived);
+}
@@ -44,6 +44,10 @@ CmdResult CommandServer::HandleServer(TreeServer* ParentOfThis, Params& params)
 	const std::string& description = params.back();
 	TreeSocket* socket = ParentOfThis->GetSocket();
 
+	// If the server has reconnected by another route then it is not going to
+	// resume the link we were holding for it.
+	TreeSocket::ReleaseHeld(servername, sid);
+
 	if (!InspIRCd::IsSID(sid))
 	{
 		socket->SendError("Invalid format server ID: "+sid+"!");
@@ -171,7 +175,26 @@ bool TreeSocket::Outbound_Reply_Server(CommandBase::Params& params)
 		 * While we're at it, create a treeserver object so we know about them.
 		 *   -- w
 		 */
-		FinishAuth(params[0], params[proto_version == PROTO_INSPIRCD_3 ? 3 : 2], params.back(), x->Hidden);
+		StartDecompressing();
+		if (journal)
+			journal->receiving = true;
+
+		const std::string& sid = params[proto_version == PROTO_INSPIRCD_3 ? 3 : 2];
+		TreeSocket* held = FindHeld(params[0], sid);
+		if (held && journal)
+		{
+			// We are holding their state from before the connection was lost so ask
+			// them to resume the link. They reply with RESUME whether they can or not.
+			capab->hidden = x->Hidden;
+			capab->sid = sid;
+			capab->description = params.back();
+			capab->name = params[0];
+			WriteLine(fmt::format("RESUME {} {} {}", held->journal->token, held->journal->received, held->journal->GetFirst()));
+			return true;
+		}
+
+		ReleaseHeld(params[0], sid);
+		FinishAuth(params[0], sid, params.back(), x->Hidden);
 
 		return true;
 	}
@@ -181,6 +204,11 @@ bool TreeSocket::Outbound_Reply_Server(CommandBase::Params& params)
 
 bool TreeSocket::CheckDuplicate(const std::string& sname, const std::string& sid)
 {
+	// A server which is reconnecting to resume the link clashes with the state
+	// we are holding for it but anything else which clashes can not be resumed.
+	if (ReleaseHeld(sname, sid, true))
+		return true;
+
 	// Check if the server name is not in use by a server that's already fully connected
 	TreeServer* CheckDupe = Utils->FindServer(sname);
 	if (CheckDupe)
@@ -230,6 +258,11 @@ bool TreeSocket::Inbound_Server(CommandBase::Params& params)
 			ServerInstance->Config->ServerId,
 			ServerInstance->Config->ServerDesc
 		));
+		this->StartCompressing();
+		this->StartDecompressing();
+		this->StartJournal();
+		if (journal)
+			journal->receiving = true;
 
 		// move to the next state, we are now waiting for THEM.
 		this->LinkState = WAIT_AUTH_2;
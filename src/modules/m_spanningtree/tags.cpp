@@ -38,3 +38,9 @@ bool ServerTags::ShouldSendTag(LocalUser* user, const ClientProtocol::MessageTag
 	// Server tags should never be sent to users.
 	return false;
 }
+
+bool ServerTags::IsCapabilityBased() const
+{
+	// The result above is the same for everyone.
+	return true;
+}
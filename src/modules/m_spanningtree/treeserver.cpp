@@ -149,6 +149,13 @@ void TreeServer::FinishBurstInternal()
 		child->FinishBurstInternal();
 }
 
+void TreeServer::SetSocket(TreeSocket* sock)
+{
+	Socket = sock;
+	for (auto* child : Children)
+		child->SetSocket(sock);
+}
+
 void TreeServer::FinishBurst()
 {
 	ServerInstance->XLines->ApplyLines();
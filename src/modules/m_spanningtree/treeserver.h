@@ -157,6 +157,11 @@ public:
 	 */
 	TreeSocket* GetSocket() const { return Socket; }
 
+	/** Set the TreeSocket pointer for this server and all servers behind it.
+	 * This is used when the link to a server is resumed over a new connection.
+	 */
+	void SetSocket(TreeSocket* sock);
+
 	/** Get the parent server.
 	 * For the root node, this returns NULL.
 	 */
@@ -71,7 +71,7 @@ enum ProtocolVersion
  * any O(n) lookups. If however, during a split or sync, we want
  * to apply an operation to a server, and any of its child objects
  * we can resort to recursion to walk the tree structure.
- * Any socket can have one of five states at any one time.
+ * Any socket can have one of six states at any one time.
  *
  * CONNECTING:	indicates an outbound socket which is
  *							waiting to be writeable.
@@ -84,8 +84,105 @@ enum ProtocolVersion
  * CONNECTED:   represents a fully authorized, fully
  *							connected server.
  * DYING:       represents a server that has had an error.
+ * HELD:        represents a server whose connection was lost
+ *							but whose state is kept until it
+ *							resumes the link or <options:resumewindow>
+ *							passes.
  */
-enum ServerState { CONNECTING, WAIT_AUTH_1, WAIT_AUTH_2, CONNECTED, DYING };
+enum ServerState { CONNECTING, WAIT_AUTH_1, WAIT_AUTH_2, CONNECTED, DYING, HELD };
+
+/** The progress of a netburst which is being sent to a server. Users and
+ * channels are remembered by their UUID and name when the netburst starts
+ * and their state is only serialised once the link has room for them. Any
+ * changes to objects which have not been sent yet are superseded by the
+ * state which is sent in the netburst.
+ */
+struct BurstProgress final
+{
+	enum Stage
+	{
+		/** Sending users and their metadata. */
+		STAGE_USERS,
+
+		/** Sending channels and their memberships, modes and metadata. */
+		STAGE_CHANNELS,
+
+		/** Sending X-lines and the end of the netburst. */
+		STAGE_FINISH
+	};
+
+	// The stage of the netburst which is currently being sent.
+	Stage stage = STAGE_USERS;
+
+	// The UUIDs of the users which were connected when the netburst started.
+	std::vector<std::string> users;
+
+	// The names of the channels which existed when the netburst started.
+	std::vector<std::string> channels;
+
+	// The position of the next user or channel to send.
+	size_t position = 0;
+};
+
+/** The lines which have been sent to a server since the link to it was
+ * established. If the connection is lost the state of the server is held for
+ * a short time and if it reconnects the lines it did not process are replayed
+ * instead of splitting it and sending a new netburst.
+ */
+struct ResumeJournal final
+{
+	// The token which both servers use to identify the link.
+	const std::string token;
+
+	// Whether we initiated the connection and should be the one to reconnect.
+	const bool outbound;
+
+	// The most recent lines which have been sent to the server.
+	std::deque<std::string> lines;
+
+	// The total length of the lines in the journal.
+	size_t bytes = 0;
+
+	// The number of lines which have been sent to the server.
+	uint64_t sent = 0;
+
+	// The number of lines which have been received from the server.
+	uint64_t received = 0;
+
+	// Whether the server has sent its SERVER line and its lines are being counted.
+	bool receiving = false;
+
+	ResumeJournal(const std::string& t, bool o)
+		: token(t)
+		, outbound(o)
+	{
+	}
+
+	/** Adds a line which has been sent to the server.
+	 * @param line The line which was sent.
+	 * @param limit The size to trim the journal to or 0 to keep every line.
+	 */
+	void Add(const std::string& line, size_t limit)
+	{
+		lines.push_back(line);
+		bytes += line.length();
+		sent++;
+
+		while (limit && bytes > limit && !lines.empty())
+		{
+			bytes -= lines.front().length();
+			lines.pop_front();
+		}
+	}
+
+	/** Retrieves the number of the oldest line which is still in the journal. */
+	uint64_t GetFirst() const { return sent - lines.size(); }
+
+	/** Determines whether the lines after the specified one can be replayed.
+	 * @param from The number of lines the server has processed.
+	 */
+	bool CanReplay(uint64_t from) const { return from >= GetFirst() && from <= sent; }
+};
 
 struct CapabData final
 {
@@ -104,6 +201,8 @@ struct CapabData final
 	std::string UserModes;
 	std::string ExtBans;
 	std::map<std::string, std::string> CapKeys;	/* CAPAB keys from other server */
+	std::string compress;			/* Compression method we want to use */
+	std::string resumetoken;		/* Token sent in our CAPAB to identify the link if it is resumed */
 	std::string ourchallenge;		/* Challenge sent for challenge/response */
 	std::string theirchallenge;		/* Challenge recv for challenge/response */
 	int capab_phase = 0;			/* Have sent CAPAB already */
@@ -132,9 +231,72 @@ class TreeSocket final
 {
 	struct BurstState;
 
+	/** Resumes sending a netburst on the next iteration of the main loop. */
+	class BurstTimer final
+		: public Timer
+	{
+	private:
+		/** The socket to resume sending the netburst to. */
+		TreeSocket* const sock;
+
+	public:
+		BurstTimer(TreeSocket* s)
+			: Timer(0, false)
+			, sock(s)
+		{
+		}
+
+		/** @copydoc Timer::Tick */
+		bool Tick() override;
+	};
+
+	/** Resumes processing the recvq on the next iteration of the main loop. */
+	class RecvQTimer final
+		: public Timer
+	{
+	private:
+		/** The socket to resume processing the recvq of. */
+		TreeSocket* const sock;
+
+	public:
+		RecvQTimer(TreeSocket* s)
+			: Timer(0, false)
+			, sock(s)
+		{
+		}
+
+		/** @copydoc Timer::Tick */
+		bool Tick() override;
+	};
+
+	/** Gives up on resuming the link once <options:resumewindow> has passed. */
+	class HoldTimer final
+		: public Timer
+	{
+	private:
+		/** The socket which is holding the state of a server. */
+		TreeSocket* const sock;
+
+	public:
+		HoldTimer(TreeSocket* s)
+			: Timer(0, false)
+			, sock(s)
+		{
+		}
+
+		/** @copydoc Timer::Tick */
+		bool Tick() override;
+	};
+
 	std::string linkID;			/* Description for this link */
 	ServerState LinkState;			/* Link state */
 	std::unique_ptr<CapabData> capab;	/* Link setup data (held until burst is sent) */
+	std::unique_ptr<BurstProgress> burst;	/* Netburst progress (held until burst is sent) */
+	BurstTimer bursttimer;			/* Resumes the netburst when the link drained without blocking */
+	RecvQTimer recvqtimer;			/* Resumes processing lines which were left in the recvq */
+	bool startdecompress = false;		/* Whether the data after the line being processed is compressed */
+	std::unique_ptr<ResumeJournal> journal;	/* Lines to replay if the link is resumed (held while connected) */
+	HoldTimer holdtimer;			/* Gives up on resuming the link when it is held */
 
 	/* The server we are talking to */
 	TreeServer* MyRoot = nullptr;
@@ -151,8 +313,11 @@ class TreeSocket final
 	/** Send all known information about a channel */
 	void SyncChannel(Channel* chan, BurstState& bs);
 
-	/** Send all users and their oper state, away state and metadata */
-	void SendUsers(BurstState& bs);
+	/** Send a user and their oper state, away state and metadata */
+	void SendUser(User* user, BurstState& bs);
+
+	/** Send more of the netburst until it is finished or the sendq reaches <performance:burstsendq> */
+	void ContinueBurst();
 
 	/** Send all additional info about the given server to this server */
 	void SendServerInfo(TreeServer* from);
@@ -188,12 +353,53 @@ class TreeSocket final
 	 */
 	std::shared_ptr<Link> AuthRemote(const CommandBase::Params& params);
 
+	/** Find the compression method with the specified name.
+	 * @param method The name of the compression method.
+	 * @return The I/O hook provider for the compression method or nullptr if it is not available.
+	 */
+	static IOHookProvider* FindCompression(const std::string& method);
+
+	/** Start compressing the data we send if both servers asked for the same compression method.
+	 * This is called immediately after we have sent our SERVER line.
+	 */
+	void StartCompressing();
+
+	/** Start decompressing the data we receive if we are compressing the data we send.
+	 * This is called when processing the SERVER line of the remote server.
+	 */
+	void StartDecompressing();
+
+	/** Start keeping a journal of the lines we send if both servers can resume the link.
+	 * This is called immediately after we have sent our SERVER line.
+	 */
+	void StartJournal();
+
+	/** Hold the state of the server if the link to it can be resumed.
+	 * This is called when the connection is lost because of an error.
+	 * @return True if the state of the server is being held; otherwise, false.
+	 */
+	bool Hold();
+
+	/** Find the socket which is holding the state of a server.
+	 * @param remotename The name of the server.
+	 * @param remotesid The SID of the server.
+	 * @return The socket which is holding the state of the server or nullptr if there is none.
+	 */
+	static TreeSocket* FindHeld(const std::string& remotename, const std::string& remotesid);
+
+	/** Take over the link to a server from the socket which was holding its state.
+	 * @param held The socket which was holding the state of the server.
+	 * @param from The number of lines the server processed before the connection was lost.
+	 */
+	void Resume(TreeSocket* held, uint64_t from);
+
 	/** Convenience function: read a line from the socket
 	 * @param line The line read
+	 * @param pos The position within the recvq to read from. On success this is advanced past the line.
 	 * @param delim The line delimiter
 	 * @return true if a line was read
 	 */
-	bool GetNextLine(std::string& line, char delim = '\n');
+	bool GetNextLine(std::string& line, size_t& pos, char delim = '\n');
 
 	/** Write a line directly to the socket bypassing the older protocol translation layer.
 	 * @param line The line to write directly to the socket.
@@ -223,6 +429,18 @@ public:
 	 */
 	ServerState GetLinkState() const { return LinkState; }
 
+	/** Determines whether we should reconnect to the server whose state this socket is holding.
+	 */
+	bool ShouldReconnect() const { return LinkState == HELD && journal->outbound; }
+
+	/** Give up on resuming the links to servers which clash with a server.
+	 * @param remotename The name of the server.
+	 * @param remotesid The SID of the server.
+	 * @param resumable Whether to keep holding the state of the server if it is the server itself.
+	 * @return True if the state of the server itself is still being held; otherwise, false.
+	 */
+	static bool ReleaseHeld(const std::string& remotename, const std::string& remotesid, bool resumable = false);
+
 	/** Get challenge set in our CAPAB for challenge/response
 	 */
 	const std::string& GetOurChallenge();
@@ -322,6 +540,10 @@ public:
 	 */
 	void OnDataReady() override;
 
+	/** Called when the socket is writable. Continues sending the netburst if one is in progress.
+	 */
+	void OnEventHandlerWrite() override;
+
 	/** Send one or more complete lines down the socket
 	 */
 	void WriteLine(const std::string& line);
@@ -337,6 +559,14 @@ public:
 	 */
 	bool Inbound_Server(CommandBase::Params& params);
 
+	/** (local) -> RESUME
+	 */
+	void Outbound_Reply_Resume(CommandBase::Params& params);
+
+	/** (local) <- RESUME
+	 */
+	void Inbound_Resume(CommandBase::Params& params);
+
 	/** Handle IRC line split
 	 */
 	void Split(const std::string& line, std::string& tags, std::string& prefix, std::string& command, CommandBase::Params& params);
@@ -25,6 +25,7 @@
 
 #include "inspircd.h"
 #include "iohook.h"
+#include "modules/compress.h"
 
 #include "main.h"
 #include "utils.h"
@@ -42,10 +43,14 @@ TreeSocket::TreeSocket(const std::shared_ptr<Link>& link, const std::shared_ptr<
 	: linkID(link->Name)
 	, LinkState(CONNECTING)
 	, capab(std::make_unique<CapabData>(dest))
+	, bursttimer(this)
+	, recvqtimer(this)
+	, holdtimer(this)
 	, age(ServerInstance->Time())
 {
 	capab->link = link;
 	capab->ac = myac;
+	capab->compress = link->Compress;
 
 	irc::sockets::sockaddrs bind;
 	if (!link->Bind.empty() && (dest.family() == AF_INET || dest.family() == AF_INET6))
@@ -78,8 +83,13 @@ TreeSocket::TreeSocket(int newfd, ListenSocket* via, const irc::sockets::sockadd
 	, linkID("inbound from " + client.addr())
 	, LinkState(WAIT_AUTH_1)
 	, capab(std::make_unique<CapabData>(client))
+	, bursttimer(this)
+	, recvqtimer(this)
+	, holdtimer(this)
 	, age(ServerInstance->Time())
 {
+	capab->compress = via->bind_tag->getString("compress");
+
 	for (auto& iohookprovref : via->iohookprovs)
 	{
 		if (!iohookprovref)
@@ -146,12 +156,26 @@ void TreeSocket::OnError(BufferedSocketError e)
 {
 	ServerInstance->SNO.WriteGlobalSno('l', "Connection to '\002{}\002' failed with error: {}",
 		linkID, GetError());
+	if (Hold())
+		return;
+
 	LinkState = DYING;
 	Close();
 }
 
 void TreeSocket::SendError(const std::string& errormessage)
 {
+	if (LinkState == HELD)
+	{
+		// We can't send anything to a server we are holding the state of.
+		SetError(errormessage);
+		Close();
+		return;
+	}
+
+	// We are closing the link on purpose so there is nothing to resume.
+	journal.reset();
+
 	WriteLine("ERROR :"+errormessage);
 	DoWrite();
 	LinkState = DYING;
@@ -185,13 +209,15 @@ CmdResult CommandSQuit::HandleServer(TreeServer* server, CommandBase::Params& pa
 	return ret;
 }
 
-bool TreeSocket::GetNextLine(std::string& line, char delim)
+bool TreeSocket::GetNextLine(std::string& line, size_t& pos, char delim)
 {
-	std::string::size_type i = recvq.find(delim);
-	if (i == std::string::npos)
+	const char* eol = static_cast<const char*>(memchr(recvq.data() + pos, delim, recvq.length() - pos));
+	if (!eol)
 		return false;
-	line.assign(recvq, 0, i);
-	recvq.erase(0, i + 1);
+
+	const size_t eolpos = eol - recvq.data();
+	line.assign(recvq, pos, eolpos - pos);
+	pos = eolpos + 1;
 	return true;
 }
 
@@ -201,8 +227,16 @@ bool TreeSocket::GetNextLine(std::string& line, char delim)
 void TreeSocket::OnDataReady()
 {
 	Utils->Creator->loopCall = true;
+
+	// Once a server is linked the lines it sends are only processed for a
+	// limited time before the rest are left in the recvq so that a large
+	// netburst does not stop other connections from being served.
+	const auto starttime = std::chrono::steady_clock::now();
+	unsigned long linecount = 0;
+
 	std::string line;
-	while (GetNextLine(line))
+	size_t linestart = 0;
+	while (GetNextLine(line, linestart))
 	{
 		std::string::size_type rline = line.find('\r');
 		if (rline != std::string::npos)
@@ -213,6 +247,11 @@ void TreeSocket::OnDataReady()
 			break;
 		}
 
+		// This is counted before the line is processed as processing it may
+		// resume the link and replace the journal.
+		if (journal && journal->receiving)
+			journal->received++;
+
 		try
 		{
 			ProcessLine(line);
@@ -226,16 +265,102 @@ void TreeSocket::OnDataReady()
 
 		if (!GetError().empty())
 			break;
+
+		if (startdecompress)
+		{
+			// Everything the remote server sent after the line we just
+			// processed has been compressed.
+			startdecompress = false;
+			std::string compressed(recvq, linestart);
+			recvq.erase(linestart);
+
+			CompressIOHook* const hook = CompressIOHook::IsCompressed(this);
+			if (!hook || !hook->StartDecompressing(this, compressed))
+			{
+				SetError("Unable to start decompressing data");
+				break;
+			}
+			recvq.append(compressed);
+		}
+
+		if (LinkState == CONNECTED && linestart < recvq.length())
+		{
+			linecount++;
+			if ((Utils->LinkReadLines && linecount >= Utils->LinkReadLines)
+				|| (Utils->LinkReadTime && std::chrono::steady_clock::now() - starttime >= std::chrono::milliseconds(Utils->LinkReadTime)))
+			{
+				recvqtimer.SetIntervalMillis(0);
+				break;
+			}
+		}
 	}
+
+	// Remove the lines we have processed from the recvq in one go.
+	if (linestart == recvq.length())
+		recvq.clear();
+	else if (linestart)
+		recvq.erase(0, linestart);
+
 	if (LinkState != CONNECTED && recvq.length() > 4096)
 		SendError("RecvQ overrun (line too long)");
 	Utils->Creator->loopCall = false;
 }
 
-static std::string newline("\n");
+bool TreeSocket::RecvQTimer::Tick()
+{
+	if (sock->GetError().empty())
+		sock->OnDataReady();
+	return true;
+}
+
+IOHookProvider* TreeSocket::FindCompression(const std::string& method)
+{
+	if (method.empty())
+		return nullptr;
+
+	return static_cast<IOHookProvider*>(ServerInstance->Modules.FindService(SERVICE_IOHOOK, "compress/" + method));
+}
+
+void TreeSocket::StartCompressing()
+{
+	// Both servers have to ask for the same method. Older servers never do.
+	const auto it = capab->CapKeys.find("COMPRESSION");
+	if (it == capab->CapKeys.end() || it->second != capab->compress)
+		return;
+
+	IOHookProvider* const prov = FindCompression(capab->compress);
+	if (!prov)
+		return;
+
+	prov->OnConnect(this);
+	ServerInstance->Logs.Debug(MODNAME, "Compressing the link to {} using {}", linkID, capab->compress);
+}
+
+void TreeSocket::StartDecompressing()
+{
+	// The remote server starts compressing at the same point that we did.
+	if (CompressIOHook::IsCompressed(this))
+		startdecompress = true;
+}
+
+static const StreamSocket::SendQueue::Element newline("\n");
 
 void TreeSocket::WriteLineInternal(const std::string& line)
 {
+	if (journal)
+	{
+		if (LinkState == HELD)
+		{
+			// This is sent when the server resumes the link. If we have to keep
+			// too much for it then we give up on it sooner.
+			journal->Add(line, 0);
+			if (journal->bytes > Utils->ResumeBuffer)
+				holdtimer.SetIntervalMillis(0);
+			return;
+		}
+		journal->Add(line, Utils->ResumeBuffer);
+	}
+
 	ServerInstance->Logs.RawIO(MODNAME, "S[{}] O {}", GetFd(), line);
 	this->WriteData(line);
 	this->WriteData(newline);
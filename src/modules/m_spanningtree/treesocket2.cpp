@@ -39,6 +39,9 @@ void TreeSocket::Error(CommandBase::Params& params)
 {
 	const std::string msg = params.empty() ? "" : params[0];
 	SetError("received ERROR " + msg);
+
+	// The remote server closed the link on purpose so there is nothing to resume.
+	journal.reset();
 }
 
 void TreeSocket::Split(const std::string& line, std::string& tags, std::string& prefix, std::string& command, CommandBase::Params& params)
@@ -174,6 +177,10 @@ void TreeSocket::ProcessLine(std::string& line)
 					}
 				}
 
+				// They are sending a netburst so any state we were holding for them
+				// from before the connection was lost is out of date.
+				ReleaseHeld(capab->name, capab->sid);
+
 				// Check for duplicate server name/sid again, it's possible that a new
 				// server was introduced while we were waiting for them to send BURST.
 				// (we do not reserve their server name/sid when they send SERVER, we do it now)
@@ -182,6 +189,10 @@ void TreeSocket::ProcessLine(std::string& line)
 
 				FinishAuth(capab->name, capab->sid, capab->description, capab->hidden);
 			}
+			else if (command == "RESUME")
+			{
+				this->Inbound_Resume(params);
+			}
 			else if (command == "ERROR")
 			{
 				this->Error(params);
@@ -209,6 +220,10 @@ void TreeSocket::ProcessLine(std::string& line)
 				// Our credentials have been accepted, send netburst. (this puts US into the CONNECTED state)
 				this->Outbound_Reply_Server(params);
 			}
+			else if (command == "RESUME")
+			{
+				this->Outbound_Reply_Resume(params);
+			}
 			else if (command == "ERROR")
 			{
 				this->Error(params);
@@ -234,6 +249,7 @@ void TreeSocket::ProcessLine(std::string& line)
 		break;
 
 		case DYING:
+		case HELD:
 		break;
 	}
 }
@@ -418,12 +434,32 @@ void TreeSocket::OnTimeout()
 
 void TreeSocket::Close()
 {
+	if (LinkState == HELD)
+	{
+		// The server did not resume the link so it has to split now.
+		LinkState = DYING;
+		journal.reset();
+		ServerInstance->GlobalCulls.AddItem(this);
+		if (MyRoot && !MyRoot->IsDead())
+			MyRoot->SQuit(GetError(), true);
+		return;
+	}
+
 	if (!HasFd())
 		return;
 
+	// If the remote server can resume the link then tell it that we are closing
+	// it on purpose so that it does not wait for us.
+	if (journal && GetError().empty())
+	{
+		journal.reset();
+		WriteLine("ERROR :Link closed");
+	}
+
 	ServerInstance->GlobalCulls.AddItem(this);
 	this->BufferedSocket::Close();
 	SetError("Remote host closed connection");
+	burst.reset();
 
 	// Connection closed.
 	// If the connection is fully up (state CONNECTED)
@@ -145,36 +145,51 @@ void SpanningTreeUtilities::GetListOfServersForChannel(const Channel* c, TreeSoc
 			minrank = mh->GetPrefixRank();
 	}
 
-	TreeServer::ChildServers children = TreeRoot->GetChildren();
-	for (const auto& [user, memb] : c->GetUsers())
+	// Exempt users only stop a message being routed to their server if every
+	// other member on that server which would receive it is also exempt.
+	insp::flat_map<Server*, size_t> exempted;
+	for (auto* user : exempt_list)
 	{
 		if (IS_LOCAL(user))
 			continue;
 
-		if (minrank && memb->GetRank() < minrank)
+		const Membership* memb = c->GetUser(user);
+		if (!memb || memb->GetRank() < minrank)
 			continue;
 
-		if (exempt_list.find(user) == exempt_list.end())
-		{
-			TreeServer* best = TreeServer::Get(user);
-			list.insert(best->GetSocket());
+		exempted[user->server]++;
+	}
 
-			TreeServer::ChildServers::iterator citer = std::find(children.begin(), children.end(), best);
-			if (citer != children.end())
-				children.erase(citer);
-		}
+	for (const auto& [server, members] : c->GetServerMembers())
+	{
+		const size_t count = members.CountAtLeast(minrank);
+		if (!count)
+			continue;
+
+		auto it = exempted.find(server);
+		if (it != exempted.end() && it->second >= count)
+			continue;
+
+		list.insert(static_cast<TreeServer*>(server)->GetSocket());
 	}
 
 	// Check whether the servers which do not have users in the channel might need this message. This
 	// is used to keep the chanhistory module synchronised between servers.
+	if (Creator->routeeventprov.GetSubscribers().empty())
+		return;
+
 	for (const auto &[_, server] : Utils->serverlist)
 	{
 		if (!server->GetRoute())
 			continue; // Local server
 
+		TreeSocket* sock = server->GetRoute()->GetSocket();
+		if (list.find(sock) != list.end())
+			continue; // Already being routed to this server.
+
 		ModResult result = Creator->routeeventprov.FirstResult(&ServerProtocol::RouteEventListener::OnRouteMessage, c, server);
 		if (result == MOD_RES_ALLOW)
-			list.insert(server->GetRoute()->GetSocket());
+			list.insert(sock);
 	}
 }
 
@@ -241,6 +256,7 @@ void SpanningTreeUtilities::ReadConfiguration()
 	AnnounceTSChange = options->getBool("announcets");
 	PingWarnTime = options->getDuration("pingwarning", 15);
 	PingFreq = options->getDuration("serverpingfreq", 60, 1);
+	ResumeWindow = options->getDuration("resumewindow", 0);
 
 	const auto& security = ServerInstance->Config->ConfValue("security");
 	FlatLinks = security->getBool("flatlinks");
@@ -249,6 +265,10 @@ void SpanningTreeUtilities::ReadConfiguration()
 
 	const auto& performance = ServerInstance->Config->ConfValue("performance");
 	quiet_bursts = performance->getBool("quietbursts");
+	BurstSendQ = performance->getNum<unsigned long>("burstsendq", 1024 * 1024);
+	LinkReadLines = performance->getNum<unsigned long>("linkreadlines", 0);
+	LinkReadTime = performance->getNum<unsigned long>("linkreadtime", 50);
+	ResumeBuffer = performance->getNum<unsigned long>("resumebuffer", 1024 * 1024, 1);
 
 	if (PingWarnTime >= PingFreq)
 		PingWarnTime = 0;
@@ -291,6 +311,7 @@ void SpanningTreeUtilities::ReadConfiguration()
 		L->HiddenFromStats = tag->getBool("statshidden");
 		L->Timeout = tag->getDuration("timeout", 30);
 		L->Hook = tag->getString("sslprofile");
+		L->Compress = tag->getString("compress");
 		L->Bind = tag->getString("bind");
 		L->Hidden = tag->getBool("hidden");
 
@@ -82,6 +82,26 @@ public:
 	 */
 	bool quiet_bursts;
 
+	/** The size of the sendq at which sending a netburst is paused until the
+	 * link has caught up or 0 to send the entire netburst at once.
+	 */
+	unsigned long BurstSendQ;
+
+	/** The maximum number of lines from a server which are processed before
+	 * other connections are served or 0 for no limit.
+	 */
+	unsigned long LinkReadLines;
+
+	/** The maximum number of milliseconds spent processing lines from a
+	 * server before other connections are served or 0 for no limit.
+	 */
+	unsigned long LinkReadTime;
+
+	/** The maximum number of bytes of lines sent to a server which are kept so
+	 * that they can be replayed if the link to it is resumed.
+	 */
+	unsigned long ResumeBuffer;
+
 	/* Number of seconds that a server can go without ping
 	 * before opers are warned of high latency.
 	 */
@@ -112,6 +132,12 @@ public:
 	 */
 	unsigned long PingFreq = 60;
 
+	/** The number of seconds the state of a server which split because of a
+	 * connection error is held whilst waiting for it to resume the link or 0
+	 * to split immediately.
+	 */
+	unsigned long ResumeWindow = 0;
+
 	/** Initialise utility class
 	 */
 	SpanningTreeUtilities(ModuleSpanningTree* Creator);
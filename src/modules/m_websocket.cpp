@@ -193,12 +193,12 @@ class WebSocketHook final
 		return pos;
 	}
 
-	static StreamSocket::SendQueue::Element PrepareSendQElem(size_t size, OpCode opcode)
+	static std::string PrepareSendQElem(size_t size, OpCode opcode)
 	{
 		unsigned char header[MAXHEADERSIZE];
 		const size_t n = FillHeader(header, size, opcode);
 
-		return StreamSocket::SendQueue::Element(reinterpret_cast<const char*>(header), n);
+		return std::string(reinterpret_cast<const char*>(header), n);
 	}
 
 	int HandleAppData(StreamSocket* sock, std::string& appdataout, bool allowlarge)
@@ -289,7 +289,7 @@ class WebSocketHook final
 
 		if (isping)
 		{
-			StreamSocket::SendQueue::Element elem = PrepareSendQElem(appdata.length(), OP_PONG);
+			std::string elem = PrepareSendQElem(appdata.length(), OP_PONG);
 			elem.append(appdata);
 			GetSendQ().push_back(elem);
 
@@ -0,0 +1,623 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "inspircd.h"
+#include "threadsocket.h"
+
+#if __has_include(<sys/epoll.h>) && __has_include(<sys/eventfd.h>)
+# include <sys/epoll.h>
+# include <sys/eventfd.h>
+# include <unistd.h>
+
+namespace
+{
+	/** The maximum number of reads to perform on one socket before moving on to the next. */
+	constexpr size_t MAX_READS = 8;
+
+	/** The maximum number of buffers to pass to a single writev() call. */
+	constexpr size_t MAX_IOVECS = std::min<size_t>(IOV_MAX, 128);
+
+	/** The maximum number of events to retrieve from epoll at once. */
+	constexpr size_t MAX_EVENTS = 128;
+}
+
+/** The state of a socket which is attached to a network thread. */
+struct NetworkLink final
+	: public std::enable_shared_from_this<NetworkLink>
+{
+	/** The thread which performs I/O for the socket. */
+	NetworkThread* const thread;
+
+	/** The socket which this link belongs to or nullptr if it has been detached. Only used on the main thread. */
+	StreamSocket* sock;
+
+	/** Guards all of the members below. Must be locked before the queue lock of the thread. */
+	std::mutex mutex;
+
+	/** The file descriptor of the socket or -1 if it has been detached. */
+	int fd;
+
+	/** Data which has been received but not yet passed to the main thread. */
+	std::string recvq;
+
+	/** If non-empty then the error which the thread encountered on the socket. */
+	std::string error;
+
+	/** Data which is waiting to be written to the socket. */
+	StreamSocket::SendQueue sendq;
+
+	/** The number of bytes in the send queue. This can be read without holding the mutex. */
+	std::atomic<size_t> sendqbytes = 0;
+
+	/** Whether the link is in the ready queue of its thread. */
+	bool readyqueued = false;
+
+	/** Whether the link is in the write queue of its thread. */
+	bool writequeued = false;
+
+	NetworkLink(NetworkThread* t, StreamSocket* s)
+		: thread(t)
+		, sock(s)
+		, fd(s->GetFd())
+	{
+	}
+};
+
+class NetworkThread final
+	: public SocketThread
+{
+private:
+	typedef std::vector<std::shared_ptr<NetworkLink>> LinkList;
+
+	/** The epoll instance which waits for events on the sockets of this thread. */
+	int epollfd;
+
+	/** The eventfd which wakes the thread up when its queues have changed. */
+	int wakefd;
+
+	/** The buffer which data is received into. */
+	std::vector<char> buffer;
+
+	/** Links which have data or an error for the main thread. Guarded by the queue lock. */
+	LinkList ready;
+
+	/** Links which have data waiting to be written. Guarded by the queue lock. */
+	LinkList writes;
+
+	/** Links which have been detached and can be released. Guarded by the queue lock. */
+	LinkList removed;
+
+	/** Whether the thread has been woken but has not processed its queues yet. Guarded by the queue lock. */
+	bool wakepending = false;
+
+	/** Whether the thread has been asked to exit. Guarded by the queue lock. */
+	bool shutdown = false;
+
+	/** Links which still had data waiting when the thread stopped reading from them. Only used on the thread. */
+	LinkList rereads;
+
+	/** The number of bytes received since the main thread last updated the socket engine statistics. */
+	std::atomic<size_t> bytesin = 0;
+
+	/** The number of bytes sent since the main thread last updated the socket engine statistics. */
+	std::atomic<size_t> bytesout = 0;
+
+	/** Wakes the thread up. */
+	void Wake()
+	{
+		eventfd_write(wakefd, 1);
+	}
+
+	/** Reads from a socket. The link must be locked.
+	 * @param link The link to read from.
+	 * @return True if the main thread needs to be told about the link; otherwise, false.
+	 */
+	bool ReadLink(NetworkLink& link)
+	{
+		if (!link.error.empty())
+			return false;
+
+		const size_t oldsize = link.recvq.size();
+		for (size_t reads = 0; ; ++reads)
+		{
+			if (reads == MAX_READS)
+			{
+				// Give the other sockets a chance; we will come back to this one.
+				rereads.push_back(link.shared_from_this());
+				break;
+			}
+
+			const ssize_t rv = recv(link.fd, buffer.data(), buffer.size(), 0);
+			if (rv > 0)
+			{
+				bytesin += static_cast<size_t>(rv);
+				link.recvq.append(buffer.data(), rv);
+				if (static_cast<size_t>(rv) < buffer.size())
+					break; // The socket has been drained.
+			}
+			else if (rv == 0)
+			{
+				link.error = "Connection closed";
+				return true;
+			}
+			else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				break;
+			}
+			else if (errno != EINTR)
+			{
+				link.error = strerror(errno);
+				return true;
+			}
+		}
+
+		// Only bother the main thread when there is a complete line for it to
+		// process or when the line is long enough that it might exceed the recvq.
+		if (link.recvq.size() >= buffer.size())
+			return true;
+		return memchr(link.recvq.data() + oldsize, '\n', link.recvq.size() - oldsize) != nullptr;
+	}
+
+	/** Writes as much of the send queue of a socket as possible. The link must be locked.
+	 * @param link The link to write to.
+	 * @return True if the main thread needs to be told about the link; otherwise, false.
+	 */
+	bool FlushLink(NetworkLink& link)
+	{
+		StreamSocket::SendQueue& sq = link.sendq;
+		while (!sq.empty() && link.error.empty())
+		{
+			SocketEngine::IOVector iovecs[MAX_IOVECS];
+			int bufcount = 0;
+			for (StreamSocket::SendQueue::const_iterator i = sq.begin(); i != sq.end() && bufcount < static_cast<int>(MAX_IOVECS); ++i, ++bufcount)
+			{
+				iovecs[bufcount].iov_base = const_cast<char*>(i->data());
+				iovecs[bufcount].iov_len = i->length();
+			}
+
+			const ssize_t rv = writev(link.fd, iovecs, bufcount);
+			if (rv > 0)
+			{
+				bytesout += static_cast<size_t>(rv);
+				size_t remaining = rv;
+				while (remaining && !sq.empty())
+				{
+					const size_t frontlen = sq.front().length();
+					if (frontlen <= remaining)
+					{
+						remaining -= frontlen;
+						sq.pop_front();
+					}
+					else
+					{
+						sq.erase_front(remaining);
+						remaining = 0;
+					}
+				}
+			}
+			else if (rv == 0)
+			{
+				link.error = "Connection closed";
+			}
+			else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				break; // We will receive EPOLLOUT when the socket is writable again.
+			}
+			else if (errno != EINTR)
+			{
+				link.error = strerror(errno);
+			}
+		}
+
+		link.sendqbytes = sq.bytes();
+		return !link.error.empty();
+	}
+
+	/** Queues a link to be passed to the main thread. The link must be locked.
+	 * @param link The link to queue.
+	 * @param readybatch The list of links to pass to the main thread at the end of this iteration.
+	 */
+	static void QueueReady(NetworkLink& link, LinkList& readybatch)
+	{
+		if (link.readyqueued)
+			return;
+
+		link.readyqueued = true;
+		readybatch.push_back(link.shared_from_this());
+	}
+
+public:
+	/** The number of sockets attached to this thread. Only used on the main thread. */
+	size_t linkcount = 0;
+
+	NetworkThread()
+		: buffer(ServerInstance->Config->NetBufferSize)
+	{
+		epollfd = epoll_create1(EPOLL_CLOEXEC);
+		if (epollfd < 0)
+			throw CoreException("Could not create epoll instance: " + SocketEngine::LastError());
+
+		wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (wakefd < 0)
+		{
+			close(epollfd);
+			throw CoreException("Could not create eventfd: " + SocketEngine::LastError());
+		}
+
+		epoll_event ev = { };
+		ev.events = EPOLLIN;
+		ev.data.ptr = nullptr;
+		epoll_ctl(epollfd, EPOLL_CTL_ADD, wakefd, &ev);
+	}
+
+	~NetworkThread() override
+	{
+		close(wakefd);
+		close(epollfd);
+	}
+
+	/** Starts performing I/O for a socket.
+	 * @param link The link for the socket.
+	 * @return True if the socket was added; otherwise, false.
+	 */
+	bool Add(const std::shared_ptr<NetworkLink>& link)
+	{
+		epoll_event ev = { };
+		ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		ev.data.ptr = link.get();
+		if (epoll_ctl(epollfd, EPOLL_CTL_ADD, link->fd, &ev) < 0)
+			return false;
+
+		linkcount++;
+		return true;
+	}
+
+	/** Stops performing I/O for a socket. The fd of the link must already have been reset.
+	 * @param link The link for the socket.
+	 * @param fd The file descriptor of the socket.
+	 */
+	void Remove(const std::shared_ptr<NetworkLink>& link, int fd)
+	{
+		epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, nullptr);
+		linkcount--;
+
+		// The thread may still be using the link so it has to release it.
+		LockQueue();
+		removed.push_back(link);
+		const bool wake = !wakepending;
+		wakepending = true;
+		UnlockQueue();
+
+		if (wake)
+			Wake();
+	}
+
+	/** Asks the thread to flush the send queue of a link. The link must be locked.
+	 * @param link The link to flush.
+	 */
+	void QueueWrite(const std::shared_ptr<NetworkLink>& link)
+	{
+		LockQueue();
+		writes.push_back(link);
+		const bool wake = !wakepending;
+		wakepending = true;
+		UnlockQueue();
+
+		if (wake)
+			Wake();
+	}
+
+	/** Adds the bytes transferred by this thread to the socket engine statistics. */
+	void UpdateStats()
+	{
+		const size_t in = bytesin.exchange(0);
+		if (in)
+			SocketEngine::stats.UpdateReadCounters(static_cast<ssize_t>(in));
+
+		const size_t out = bytesout.exchange(0);
+		if (out)
+			SocketEngine::stats.UpdateWriteCounters(static_cast<ssize_t>(out));
+	}
+
+	void OnStart() override
+	{
+		epoll_event events[MAX_EVENTS];
+		LinkList readybatch;
+		LinkList pending;
+		for (;;)
+		{
+			const int count = epoll_wait(epollfd, events, MAX_EVENTS, rereads.empty() ? -1 : 0);
+
+			pending.swap(rereads);
+			for (const auto& link : pending)
+			{
+				std::lock_guard<std::mutex> lock(link->mutex);
+				if (link->fd >= 0 && ReadLink(*link))
+					QueueReady(*link, readybatch);
+			}
+			pending.clear();
+
+			for (int i = 0; i < count; ++i)
+			{
+				NetworkLink* const link = static_cast<NetworkLink*>(events[i].data.ptr);
+				if (!link)
+				{
+					eventfd_t dummy;
+					eventfd_read(wakefd, &dummy);
+					continue;
+				}
+
+				std::lock_guard<std::mutex> lock(link->mutex);
+				if (link->fd < 0)
+					continue; // Detached since the event was received.
+
+				bool notify = false;
+				if (events[i].events & EPOLLOUT)
+					notify |= FlushLink(*link);
+				if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+					notify |= ReadLink(*link);
+				if (notify)
+					QueueReady(*link, readybatch);
+			}
+
+			LinkList finished;
+			LockQueue();
+			wakepending = false;
+			const bool exiting = shutdown;
+			pending.swap(writes);
+			finished.swap(removed);
+			UnlockQueue();
+
+			for (const auto& link : pending)
+			{
+				std::lock_guard<std::mutex> lock(link->mutex);
+				link->writequeued = false;
+				if (link->fd >= 0 && FlushLink(*link))
+					QueueReady(*link, readybatch);
+			}
+			pending.clear();
+
+			if (!readybatch.empty())
+			{
+				LockQueue();
+				ready.insert(ready.end(), readybatch.begin(), readybatch.end());
+				UnlockQueue();
+				readybatch.clear();
+				NotifyParent();
+			}
+
+			if (exiting)
+				break;
+		}
+	}
+
+	void OnStop() override
+	{
+		LockQueue();
+		shutdown = true;
+		UnlockQueue();
+		Wake();
+	}
+
+	void OnNotify() override
+	{
+		LinkList batch;
+		LockQueue();
+		batch.swap(ready);
+		UnlockQueue();
+
+		UpdateStats();
+		for (const auto& link : batch)
+		{
+			StreamSocket* const sock = link->sock;
+			std::string error;
+			bool newdata = false;
+			{
+				std::lock_guard<std::mutex> lock(link->mutex);
+				link->readyqueued = false;
+				if (sock)
+				{
+					newdata = !link->recvq.empty();
+					sock->recvq.append(link->recvq);
+					link->recvq.clear();
+					error = link->error;
+				}
+			}
+
+			if (!sock || !sock->error.empty())
+				continue; // Detached or already dead.
+
+			if (newdata)
+			{
+				try
+				{
+					sock->OnDataReady();
+				}
+				catch (const CoreException& ex)
+				{
+					ServerInstance->Logs.Normal("SOCKET", "Caught exception in socket processing on FD {} - '{}'",
+						sock->GetFd(), ex.GetReason());
+					sock->SetError(ex.GetReason());
+				}
+			}
+
+			if (!error.empty())
+				sock->SetError(error);
+			sock->CheckError(I_ERR_OTHER);
+		}
+	}
+};
+
+bool NetworkThreadManager::Start()
+{
+	if (started)
+		return !threads.empty();
+
+	started = true;
+	for (size_t i = 0; i < ServerInstance->Config->NetThreads; ++i)
+	{
+		try
+		{
+			auto* thread = new NetworkThread();
+			threads.push_back(thread);
+			thread->Start();
+		}
+		catch (const CoreException& ex)
+		{
+			ServerInstance->Logs.Warning("SOCKET", "Unable to start network thread: {}", ex.GetReason());
+			break;
+		}
+	}
+
+	if (!threads.empty())
+		ServerInstance->Logs.Normal("SOCKET", "Started {} network threads for client I/O", threads.size());
+	return !threads.empty();
+}
+
+bool NetworkThreadManager::Attach(StreamSocket* sock)
+{
+	if (sock->netlink || sock->GetIOHook() || !sock->HasFd() || !sock->error.empty())
+		return false;
+
+	// Data that the main thread could not write yet is waiting for a write
+	// event from the socket engine so leave these sockets where they are.
+	if (sock->GetEventMask() & FD_WRITE_WILL_BLOCK)
+		return false;
+
+	if (!Start())
+		return false;
+
+	NetworkThread* thread = threads.front();
+	for (auto* candidate : threads)
+	{
+		if (candidate->linkcount < thread->linkcount)
+			thread = candidate;
+	}
+
+	SocketEngine::ChangeEventMask(sock, FD_WANT_NO_READ | FD_WANT_NO_WRITE);
+	auto link = std::make_shared<NetworkLink>(thread, sock);
+	if (!thread->Add(link))
+	{
+		SocketEngine::ChangeEventMask(sock, FD_WANT_FAST_READ | FD_WANT_EDGE_WRITE);
+		return false;
+	}
+
+	sock->netlink = std::move(link);
+	if (!sock->sendq.empty())
+		Write(sock);
+	return true;
+}
+
+void NetworkThreadManager::Detach(StreamSocket* sock, bool resume)
+{
+	std::shared_ptr<NetworkLink> link = std::move(sock->netlink);
+	if (!link)
+		return;
+
+	StreamSocket::SendQueue unsent;
+	int fd;
+	{
+		std::lock_guard<std::mutex> lock(link->mutex);
+		fd = link->fd;
+		link->fd = -1;
+		link->sock = nullptr;
+		std::swap(unsent, link->sendq);
+		link->sendqbytes = 0;
+		sock->recvq.append(link->recvq);
+		link->recvq.clear();
+	}
+	link->thread->Remove(link, fd);
+
+	// Anything the thread did not send goes before what has been queued since.
+	if (!unsent.empty())
+	{
+		unsent.moveall(sock->sendq);
+		std::swap(unsent, sock->sendq);
+	}
+
+	if (resume)
+	{
+		int mask = FD_WANT_FAST_READ | FD_WANT_EDGE_WRITE;
+		if (!sock->sendq.empty())
+			mask |= FD_ADD_TRIAL_WRITE;
+		SocketEngine::ChangeEventMask(sock, mask);
+	}
+}
+
+void NetworkThreadManager::Write(StreamSocket* sock)
+{
+	const std::shared_ptr<NetworkLink>& link = sock->netlink;
+	std::lock_guard<std::mutex> lock(link->mutex);
+	link->sendq.moveall(sock->sendq);
+	link->sendqbytes = link->sendq.bytes();
+	if (!link->writequeued)
+	{
+		link->writequeued = true;
+		link->thread->QueueWrite(link);
+	}
+	link->thread->UpdateStats();
+}
+
+size_t NetworkThreadManager::GetSendQSize(const StreamSocket* sock) const
+{
+	return sock->netlink->sendqbytes.load();
+}
+
+void NetworkThreadManager::Stop()
+{
+	for (auto* thread : threads)
+	{
+		thread->Stop();
+		delete thread;
+	}
+	threads.clear();
+}
+
+#else
+
+bool NetworkThreadManager::Start()
+{
+	if (!started && ServerInstance->Config->NetThreads)
+		ServerInstance->Logs.Warning("SOCKET", "<performance:netthreads> is not supported on this platform; performing client I/O on the main thread.");
+
+	started = true;
+	return false;
+}
+
+bool NetworkThreadManager::Attach(StreamSocket* sock)
+{
+	return Start();
+}
+
+void NetworkThreadManager::Detach(StreamSocket* sock, bool resume)
+{
+}
+
+void NetworkThreadManager::Write(StreamSocket* sock)
+{
+}
+
+size_t NetworkThreadManager::GetSendQSize(const StreamSocket* sock) const
+{
+	return 0;
+}
+
+void NetworkThreadManager::Stop()
+{
+}
+
+#endif
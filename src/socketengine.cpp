@@ -49,6 +49,8 @@ size_t SocketEngine::CurrentSetSize = 0;
  */
 std::set<int> SocketEngine::trials;
 
+bool SocketEngine::deferwrites = false;
+
 size_t SocketEngine::MaxSetSize = 0;
 
 /** Socket engine statistics: count of various events, bandwidth usage
@@ -137,6 +139,26 @@ void SocketEngine::DispatchTrialWrites()
 	}
 }
 
+int SocketEngine::Dispatch(bool coalesce)
+{
+	DispatchTrialWrites();
+	ServerInstance->LoopStats.EndPhase(MainLoopStats::PHASE_WRITES);
+
+	// Everything which is written while handling events is queued and then
+	// flushed with as few system calls as possible once all events are done.
+	deferwrites = coalesce;
+	const int events = DispatchEvents();
+	deferwrites = false;
+	ServerInstance->LoopStats.EndPhase(MainLoopStats::PHASE_EVENTS);
+
+	if (coalesce)
+	{
+		DispatchTrialWrites();
+		ServerInstance->LoopStats.EndPhase(MainLoopStats::PHASE_FLUSH);
+	}
+	return events;
+}
+
 bool SocketEngine::AddFdRef(EventHandler* eh)
 {
 	int fd = eh->GetFd();
@@ -317,6 +339,13 @@ void SocketEngine::Statistics::UpdateWriteCounters(ssize_t len_out)
 		ErrorEvents++;
 }
 
+void SocketEngine::Statistics::OnWakeup(int events)
+{
+	ServerInstance->LoopStats.EndPhase(MainLoopStats::PHASE_WAIT);
+	if (events >= 0)
+		EventsPerWakeup.record(static_cast<uint64_t>(events));
+}
+
 void SocketEngine::Statistics::CheckFlush() const
 {
 	// Reset the in/out byte counters if it has been more than a second
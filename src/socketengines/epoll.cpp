@@ -40,6 +40,25 @@ namespace
 	/** These are used by epoll() to hold socket events
 	 */
 	std::vector<struct epoll_event> events(16);
+
+	/** The state of a file descriptor as far as the kernel is concerned. */
+	struct KernelState final
+	{
+		/** The epoll events which are currently registered with the kernel. */
+		unsigned events = 0;
+
+		/** Whether the file descriptor is in the changed list. */
+		bool changed = false;
+	};
+
+	/** Kernel state for each file descriptor, indexed by the file descriptor. */
+	std::vector<KernelState> kernelstate;
+
+	/** File descriptors which have had their event mask changed since the kernel was last updated. */
+	std::vector<int> changedfds;
+
+	/** The number of mask changes which would have needed an epoll_ctl call if they had been applied immediately. */
+	unsigned long pendingchanges = 0;
 }
 
 void SocketEngine::Init()
@@ -113,6 +132,10 @@ bool SocketEngine::AddFd(EventHandler* eh, int event_mask)
 
 	ServerInstance->Logs.Debug("SOCKET", "New file descriptor: {}", fd);
 
+	if (static_cast<size_t>(fd) >= kernelstate.size())
+		kernelstate.resize(std::max<size_t>(fd + 1, kernelstate.size() * 2));
+	kernelstate[fd].events = ev.events;
+
 	eh->SetEventMask(event_mask);
 	ResizeDouble(events);
 
@@ -121,16 +144,18 @@ bool SocketEngine::AddFd(EventHandler* eh, int event_mask)
 
 void SocketEngine::OnSetEvent(EventHandler* eh, int old_mask, int new_mask)
 {
-	unsigned old_events = mask_to_epoll(old_mask);
-	unsigned new_events = mask_to_epoll(new_mask);
-	if (old_events != new_events)
+	if (mask_to_epoll(old_mask) == mask_to_epoll(new_mask))
+		return;
+
+	// Handlers often flip their mask back and forth several times in one
+	// iteration so the kernel is only told about the final mask right before
+	// we next wait for events.
+	pendingchanges++;
+	KernelState& state = kernelstate[eh->GetFd()];
+	if (!state.changed)
 	{
-		// ok, we actually have something to tell the kernel about
-		struct epoll_event ev;
-		memset(&ev, 0, sizeof(ev));
-		ev.events = new_events;
-		ev.data.ptr = static_cast<void*>(eh);
-		epoll_ctl(EngineHandle, EPOLL_CTL_MOD, eh->GetFd(), &ev);
+		state.changed = true;
+		changedfds.push_back(eh->GetFd());
 	}
 }
 
@@ -154,6 +179,10 @@ void SocketEngine::DelFd(EventHandler* eh)
 		ServerInstance->Logs.Debug("SOCKET", "epoll_ctl can't remove socket: {}", strerror(errno));
 	}
 
+	// Any pending change to this file descriptor is now irrelevant.
+	if (static_cast<size_t>(fd) < kernelstate.size())
+		kernelstate[fd].changed = false;
+
 	SocketEngine::DelFdRef(eh);
 
 	ServerInstance->Logs.Debug("SOCKET", "Remove file descriptor: {}", fd);
@@ -161,8 +190,37 @@ void SocketEngine::DelFd(EventHandler* eh)
 
 int SocketEngine::DispatchEvents()
 {
-	int i = epoll_wait(EngineHandle, events.data(), static_cast<int>(events.size()), 1000);
+	unsigned long issued = 0;
+	for (const int fd : changedfds)
+	{
+		KernelState& state = kernelstate[fd];
+		if (!state.changed)
+			continue; // Removed since it was changed.
+
+		state.changed = false;
+		EventHandler* eh = GetRef(fd);
+		if (!eh)
+			continue;
+
+		const unsigned new_events = mask_to_epoll(eh->GetEventMask());
+		if (new_events == state.events)
+			continue; // The changes cancelled each other out.
+
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = new_events;
+		ev.data.ptr = static_cast<void*>(eh);
+		epoll_ctl(EngineHandle, EPOLL_CTL_MOD, fd, &ev);
+		state.events = new_events;
+		issued++;
+	}
+	stats.ElidedChanges += pendingchanges - issued;
+	pendingchanges = 0;
+	changedfds.clear();
+
+	int i = epoll_wait(EngineHandle, events.data(), static_cast<int>(events.size()), ServerInstance->Timers.GetWaitTime(1000));
 	ServerInstance->UpdateTime();
+	stats.OnWakeup(i);
 
 	stats.TotalEvents += i;
 
@@ -0,0 +1,492 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "inspircd.h"
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+/** A specialisation of the SocketEngine class, designed to use Linux 5.6+ io_uring.
+ *
+ * Readiness notifications are requested using one-shot IORING_OP_POLL_ADD operations which are
+ * re-armed after every event. All poll requests, cancellations and the main loop timeout are
+ * queued in the submission ring and handed to the kernel together with the wait for events so
+ * that a typical main loop iteration only makes a single io_uring_enter() call no matter how many
+ * sockets changed state.
+ */
+namespace
+{
+	/** The number of entries to request for the submission ring. */
+	constexpr unsigned int RING_ENTRIES = 4096;
+
+	/** Completion user data for operations whose result we do not care about. */
+	constexpr uint64_t IGNORE_DATA = UINT64_MAX;
+
+	/** Completion user data for the main loop timeout. */
+	constexpr uint64_t TIMEOUT_DATA = UINT64_MAX - 1;
+
+	/** The state of an fd within the engine. */
+	struct FdState final
+	{
+		/** The generation of the most recent poll request. Completions for older generations are stale. */
+		uint32_t generation = 0;
+
+		/** The poll events which are currently being waited for or 0 if no poll request is armed. */
+		unsigned int armed = 0;
+	};
+
+	/** The file descriptor of the io_uring instance. */
+	int EngineHandle = -1;
+
+	/** The io_uring setup parameters, including the ring offsets returned by the kernel. */
+	io_uring_params params;
+
+	/** The mapped submission ring, completion ring and submission queue entries. */
+	void* sqring = MAP_FAILED;
+	size_t sqringsize = 0;
+	void* cqring = MAP_FAILED;
+	size_t cqringsize = 0;
+	io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+
+	/** The next submission ring tail which has not been published to the kernel yet. */
+	unsigned int sqtail = 0;
+
+	/** The number of submission queue entries which have been queued but not yet submitted. */
+	unsigned int sqpending = 0;
+
+	/** Whether a main loop timeout is currently queued. */
+	bool timeoutpending = false;
+
+	/** The time in milliseconds at which the queued main loop timeout will complete. */
+	uint64_t timeoutdeadline = 0;
+
+	/** The main loop timeout. This must remain valid until the kernel has consumed it. */
+	__kernel_timespec timeout = { 1, 0 };
+
+	/** The state of every fd that has been added to the engine. */
+	std::vector<FdState> fdstates(16);
+
+	template <typename T>
+	T* RingPointer(void* ring, unsigned int offset)
+	{
+		return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+	}
+
+	inline unsigned int LoadAcquire(const unsigned int* ptr)
+	{
+		return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+	}
+
+	inline void StoreRelease(unsigned int* ptr, unsigned int value)
+	{
+		__atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+	}
+
+	inline uint64_t MakeUserData(int fd, uint32_t generation)
+	{
+		return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+	}
+
+	int Enter(unsigned int tosubmit, unsigned int mincomplete, unsigned int flags)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_enter, EngineHandle, tosubmit, mincomplete, flags, nullptr, 0));
+	}
+
+	/** Submits all pending submission queue entries and optionally waits for a completion. */
+	int Submit(bool wait)
+	{
+		StoreRelease(RingPointer<unsigned int>(sqring, params.sq_off.tail), sqtail);
+		while (true)
+		{
+			int ret = Enter(sqpending, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0);
+			if (ret >= 0)
+			{
+				sqpending -= std::min<unsigned int>(sqpending, ret);
+				return ret;
+			}
+
+			// EBUSY means that the completion ring is full and it needs to be drained first.
+			if (errno != EINTR)
+				return ret;
+		}
+	}
+
+	/** Retrieves an empty submission queue entry, submitting existing entries if the ring is full. */
+	io_uring_sqe* GetSQE()
+	{
+		const unsigned int head = LoadAcquire(RingPointer<unsigned int>(sqring, params.sq_off.head));
+		if (sqtail - head >= params.sq_entries)
+		{
+			Submit(false);
+			if (sqtail - LoadAcquire(RingPointer<unsigned int>(sqring, params.sq_off.head)) >= params.sq_entries)
+				return nullptr;
+		}
+
+		const unsigned int index = sqtail & *RingPointer<unsigned int>(sqring, params.sq_off.ring_mask);
+		RingPointer<unsigned int>(sqring, params.sq_off.array)[index] = index;
+		sqtail++;
+		sqpending++;
+
+		io_uring_sqe* sqe = &sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		return sqe;
+	}
+
+	unsigned int mask_to_poll(int event_mask)
+	{
+		unsigned int rv = 0;
+		if (event_mask & (FD_WANT_POLL_READ | FD_WANT_FAST_READ))
+			rv |= POLLIN;
+		if (event_mask & (FD_WANT_POLL_WRITE | FD_WANT_FAST_WRITE | FD_WANT_SINGLE_WRITE))
+			rv |= POLLOUT;
+		return rv;
+	}
+
+	FdState& GetFdState(int fd)
+	{
+		while (static_cast<size_t>(fd) >= fdstates.size())
+			fdstates.resize(fdstates.size() * 2);
+		return fdstates[fd];
+	}
+
+	/** Cancels the poll request for the specified fd if one is armed. */
+	void Disarm(int fd, FdState& state)
+	{
+		if (!state.armed)
+			return;
+
+		io_uring_sqe* sqe = GetSQE();
+		if (!sqe)
+		{
+			ServerInstance->Logs.Debug("SOCKET", "Unable to cancel poll for fd {}: submission ring is full", fd);
+			return;
+		}
+
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = MakeUserData(fd, state.generation);
+		sqe->user_data = IGNORE_DATA;
+		state.armed = 0;
+	}
+
+	/** Ensures that the poll request for the specified fd matches the event mask. */
+	void Arm(int fd, int event_mask)
+	{
+		FdState& state = GetFdState(fd);
+		const unsigned int events = mask_to_poll(event_mask);
+		if (state.armed == events)
+			return;
+
+		Disarm(fd, state);
+		if (!events)
+			return;
+
+		io_uring_sqe* sqe = GetSQE();
+		if (!sqe)
+		{
+			ServerInstance->Logs.Debug("SOCKET", "Unable to poll fd {}: submission ring is full", fd);
+			return;
+		}
+
+		state.generation++;
+		state.armed = events;
+
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = fd;
+		sqe->poll32_events = events;
+		sqe->user_data = MakeUserData(fd, state.generation);
+	}
+
+	void DestroyRing()
+	{
+		if (sqes != MAP_FAILED)
+			munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+		if (cqring != MAP_FAILED && cqring != sqring)
+			munmap(cqring, cqringsize);
+		if (sqring != MAP_FAILED)
+			munmap(sqring, sqringsize);
+		if (EngineHandle >= 0)
+			close(EngineHandle);
+
+		sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+		sqring = cqring = MAP_FAILED;
+		EngineHandle = -1;
+	}
+
+	bool CreateRing()
+	{
+		memset(&params, 0, sizeof(params));
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = RING_ENTRIES * 4;
+
+		EngineHandle = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+		if (EngineHandle < 0)
+			return false;
+
+		sqringsize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+		cqringsize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+			sqringsize = cqringsize = std::max(sqringsize, cqringsize);
+
+		sqring = mmap(nullptr, sqringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, EngineHandle, IORING_OFF_SQ_RING);
+		if (sqring == MAP_FAILED)
+			return false;
+
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+			cqring = sqring;
+		else
+		{
+			cqring = mmap(nullptr, cqringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, EngineHandle, IORING_OFF_CQ_RING);
+			if (cqring == MAP_FAILED)
+				return false;
+		}
+
+		sqes = static_cast<io_uring_sqe*>(mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, EngineHandle, IORING_OFF_SQES));
+		if (sqes == MAP_FAILED)
+			return false;
+
+		sqtail = *RingPointer<unsigned int>(sqring, params.sq_off.tail);
+		sqpending = 0;
+		timeoutpending = false;
+		return true;
+	}
+}
+
+void SocketEngine::Init()
+{
+	LookupMaxFds();
+	if (!CreateRing())
+		InitError();
+}
+
+void SocketEngine::RecoverFromFork()
+{
+	// The submission ring should only be used by the process which created it so create a new one
+	// and re-arm any file descriptors which were added before the fork.
+	DestroyRing();
+	if (!CreateRing())
+		InitError();
+
+	for (size_t fd = 0; fd < fdstates.size(); ++fd)
+	{
+		fdstates[fd].armed = 0;
+		EventHandler* eh = GetRef(static_cast<int>(fd));
+		if (eh)
+			Arm(eh->GetFd(), eh->GetEventMask());
+	}
+}
+
+void SocketEngine::Deinit()
+{
+	DestroyRing();
+}
+
+bool SocketEngine::AddFd(EventHandler* eh, int event_mask)
+{
+	int fd = eh->GetFd();
+	if (!eh->HasFd())
+	{
+		ServerInstance->Logs.Debug("SOCKET", "AddFd out of range: (fd: {})", fd);
+		return false;
+	}
+
+	if (!SocketEngine::AddFdRef(eh))
+	{
+		ServerInstance->Logs.Debug("SOCKET", "Attempt to add duplicate fd: {}", fd);
+		return false;
+	}
+
+	ServerInstance->Logs.Debug("SOCKET", "New file descriptor: {}", fd);
+
+	GetFdState(fd).armed = 0;
+	eh->SetEventMask(event_mask);
+	Arm(fd, event_mask);
+	return true;
+}
+
+void SocketEngine::OnSetEvent(EventHandler* eh, int old_mask, int new_mask)
+{
+	Arm(eh->GetFd(), new_mask);
+}
+
+void SocketEngine::DelFd(EventHandler* eh)
+{
+	int fd = eh->GetFd();
+	if (!eh->HasFd())
+	{
+		ServerInstance->Logs.Debug("SOCKET", "DelFd out of range: (fd: {})", fd);
+		return;
+	}
+
+	// A pending poll request holds a reference to the underlying socket so the cancellation has to
+	// be submitted right away or the socket will not be released when the fd is closed.
+	FdState& state = GetFdState(fd);
+	if (state.armed)
+	{
+		Disarm(fd, state);
+		Submit(false);
+	}
+
+	SocketEngine::DelFdRef(eh);
+
+	ServerInstance->Logs.Debug("SOCKET", "Remove file descriptor: {}", fd);
+}
+
+int SocketEngine::DispatchEvents()
+{
+	const int waittime = ServerInstance->Timers.GetWaitTime(1000);
+	const uint64_t deadline = TimerManager::Now() + waittime;
+	if (timeoutpending && deadline < timeoutdeadline)
+	{
+		// A timer needs to be ticked before the queued timeout completes so replace it.
+		io_uring_sqe* sqe = GetSQE();
+		if (sqe)
+		{
+			sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+			sqe->fd = -1;
+			sqe->addr = TIMEOUT_DATA;
+			sqe->user_data = IGNORE_DATA;
+			timeoutpending = false;
+		}
+	}
+
+	if (!timeoutpending)
+	{
+		io_uring_sqe* sqe = GetSQE();
+		if (sqe)
+		{
+			timeout.tv_sec = waittime / 1000;
+			timeout.tv_nsec = (waittime % 1000) * 1000000;
+
+			sqe->opcode = IORING_OP_TIMEOUT;
+			sqe->fd = -1;
+			sqe->addr = reinterpret_cast<uint64_t>(&timeout);
+			sqe->len = 1;
+			sqe->user_data = TIMEOUT_DATA;
+			timeoutpending = true;
+			timeoutdeadline = deadline;
+		}
+	}
+
+	if (Submit(true) < 0 && errno != EBUSY)
+		ServerInstance->Logs.Debug("SOCKET", "io_uring_enter failed: {}", strerror(errno));
+	ServerInstance->UpdateTime();
+
+	unsigned int* const cqhead = RingPointer<unsigned int>(cqring, params.cq_off.head);
+	const unsigned int* const cqtail = RingPointer<unsigned int>(cqring, params.cq_off.tail);
+	const unsigned int cqmask = *RingPointer<unsigned int>(cqring, params.cq_off.ring_mask);
+	const io_uring_cqe* const cqes = RingPointer<io_uring_cqe>(cqring, params.cq_off.cqes);
+
+	int i = 0;
+	unsigned int head = *cqhead;
+	const unsigned int tail = LoadAcquire(cqtail);
+	stats.OnWakeup(static_cast<int>(tail - head));
+	for (; head != tail; ++head)
+	{
+		// Copy the completion and release the slot before dispatching in case a handler submits more work.
+		const io_uring_cqe cqe = cqes[head & cqmask];
+		StoreRelease(cqhead, head + 1);
+
+		if (cqe.user_data == TIMEOUT_DATA)
+		{
+			// Timeouts which were replaced by a shorter one complete with -ECANCELED.
+			if (cqe.res != -ECANCELED)
+				timeoutpending = false;
+			continue;
+		}
+
+		if (cqe.user_data == IGNORE_DATA)
+			continue;
+
+		// Check that this completion belongs to the poll request which is currently armed.
+		const int fd = static_cast<int>(cqe.user_data & UINT32_MAX);
+		const uint32_t generation = static_cast<uint32_t>(cqe.user_data >> 32);
+		if (static_cast<size_t>(fd) >= fdstates.size())
+			continue;
+
+		FdState& state = fdstates[fd];
+		if (!state.armed || state.generation != generation)
+			continue;
+
+		EventHandler* eh = GetRef(fd);
+		if (!eh)
+			continue;
+
+		// The poll request is one-shot so it is no longer armed.
+		state.armed = 0;
+		i++;
+		stats.TotalEvents++;
+
+		if (cqe.res < 0)
+		{
+			if (cqe.res != -ECANCELED)
+			{
+				stats.ErrorEvents++;
+				eh->OnEventHandlerError(-cqe.res);
+			}
+			else if (eh == GetRef(fd))
+				Arm(fd, eh->GetEventMask());
+			continue;
+		}
+
+		const unsigned int revents = static_cast<unsigned int>(cqe.res);
+		if (revents & POLLHUP)
+		{
+			stats.ErrorEvents++;
+			eh->OnEventHandlerError(0);
+			continue;
+		}
+
+		if (revents & POLLERR)
+		{
+			stats.ErrorEvents++;
+			socklen_t codesize = sizeof(int);
+			int errcode;
+			if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &errcode, &codesize) < 0)
+				errcode = errno;
+			eh->OnEventHandlerError(errcode);
+			continue;
+		}
+
+		if (revents & POLLIN)
+		{
+			stats.ReadEvents++;
+			eh->SetEventMask(eh->GetEventMask() & ~FD_READ_WILL_BLOCK);
+			eh->OnEventHandlerRead();
+			if (eh != GetRef(fd))
+				// whoops, deleted out from under us
+				continue;
+		}
+
+		if (revents & POLLOUT)
+		{
+			stats.WriteEvents++;
+			eh->SetEventMask(eh->GetEventMask() & ~(FD_WRITE_WILL_BLOCK | FD_WANT_SINGLE_WRITE));
+			eh->OnEventHandlerWrite();
+			if (eh != GetRef(fd))
+				continue;
+		}
+
+		// Re-arm the poll request if the handler still wants events.
+		Arm(fd, eh->GetEventMask());
+	}
+
+	return i;
+}
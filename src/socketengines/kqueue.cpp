@@ -95,6 +95,30 @@ static struct kevent* GetChangeKE()
 	return &changelist[ChangePos++];
 }
 
+/** Removes a pending poll-style write filter addition from the change list.
+ * @param fd The file descriptor to remove the addition for.
+ * @return True if the most recent pending change to the write filter of the
+ *         file descriptor was a poll-style addition and it was removed;
+ *         otherwise, false.
+ */
+static bool CancelPendingWrite(int fd)
+{
+	for (unsigned int pos = ChangePos; pos-- > 0; )
+	{
+		const struct kevent& ke = changelist[pos];
+		if (static_cast<int>(ke.ident) != fd || ke.filter != EVFILT_WRITE)
+			continue;
+
+		if (ke.flags != EV_ADD)
+			return false;
+
+		std::move(changelist.begin() + pos + 1, changelist.begin() + ChangePos, changelist.begin() + pos);
+		ChangePos--;
+		return true;
+	}
+	return false;
+}
+
 bool SocketEngine::AddFd(EventHandler* eh, int event_mask)
 {
 	if (!eh->HasFd())
@@ -151,6 +175,13 @@ void SocketEngine::OnSetEvent(EventHandler* eh, int old_mask, int new_mask)
 	else if ((old_mask & FD_WANT_POLL_WRITE) && !(new_mask & FD_WANT_POLL_WRITE))
 	{
 		// removing poll-style write
+		if (CancelPendingWrite(eh->GetFd()))
+		{
+			// The filter was added in this batch so the kernel never needs to hear about it.
+			stats.ElidedChanges += 2;
+			return;
+		}
+
 		struct kevent* ke = GetChangeKE();
 		EV_SET(ke, eh->GetFd(), EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
 	}
@@ -163,13 +194,15 @@ void SocketEngine::OnSetEvent(EventHandler* eh, int old_mask, int new_mask)
 
 int SocketEngine::DispatchEvents()
 {
+	const int waittime = ServerInstance->Timers.GetWaitTime(1000);
 	struct timespec ts;
-	ts.tv_nsec = 0;
-	ts.tv_sec = 1;
+	ts.tv_nsec = (waittime % 1000) * 1000000;
+	ts.tv_sec = waittime / 1000;
 
 	int i = kevent(EngineHandle, &changelist.front(), ChangePos, &ke_list.front(), static_cast<int>(ke_list.size()), &ts);
 	ChangePos = 0;
 	ServerInstance->UpdateTime();
+	stats.OnWakeup(i);
 
 	if (i < 0)
 		return i;
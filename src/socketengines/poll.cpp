@@ -157,9 +157,10 @@ void SocketEngine::DelFd(EventHandler* eh)
 
 int SocketEngine::DispatchEvents()
 {
-	int i = poll(&events[0], static_cast<unsigned int>(CurrentSetSize), 1000);
+	int i = poll(&events[0], static_cast<unsigned int>(CurrentSetSize), ServerInstance->Timers.GetWaitTime(1000));
 	int processed = 0;
 	ServerInstance->UpdateTime();
+	stats.OnWakeup(i);
 
 	for (size_t index = 0; index < CurrentSetSize && processed < i; index++)
 	{
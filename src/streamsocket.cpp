@@ -33,6 +33,10 @@
 #include "inspircd.h"
 #include "iohook.h"
 
+#ifndef _WIN32
+# include <netinet/tcp.h>
+#endif
+
 static IOHook* GetNextHook(IOHook* hook)
 {
 	IOHookMiddle* const iohm = IOHookMiddle::ToMiddleHook(hook);
@@ -105,6 +109,9 @@ void StreamSocket::Close()
 		return;
 
 	closing = true;
+	if (netlink)
+		ServerInstance->NetThreads.Detach(this, false);
+
 	if (HasFd())
 	{
 		// final chance, dump as much of the sendq as we can
@@ -126,6 +133,10 @@ void StreamSocket::Close()
 
 void StreamSocket::Close(bool writeblock)
 {
+	// The main thread has to see the write events to know when to close.
+	if (netlink && writeblock)
+		ServerInstance->NetThreads.Detach(this, true);
+
 	if (GetSendQSize() != 0 && writeblock)
 		closeonempty = true;
 	else
@@ -230,6 +241,13 @@ void StreamSocket::DoWrite()
 		return;
 	}
 
+	if (netlink)
+	{
+		// The network thread flushes the queue and will report any errors.
+		ServerInstance->NetThreads.Write(this);
+		return;
+	}
+
 	SendQueue* psendq = &sendq;
 	IOHook* hook = GetIOHook();
 	while (hook)
@@ -269,6 +287,12 @@ void StreamSocket::FlushSendQ(SendQueue& sq)
 		// don't even try if we are known to be blocking
 		if (GetEventMask() & FD_WRITE_WILL_BLOCK)
 			return;
+#ifdef TCP_CORK
+		// If the sendq needs more than one writev() call then cork the socket
+		// to avoid sending a partially filled segment between the calls.
+		const bool corked = sq.size() > MYIOV_MAX && !SocketEngine::SetOption<int>(this, IPPROTO_TCP, TCP_CORK, 1);
+#endif
+
 		// start out optimistic - we won't need to write any more
 		int eventChange = FD_WANT_EDGE_WRITE;
 		while (error.empty() && !sq.empty() && eventChange == FD_WANT_EDGE_WRITE)
@@ -340,6 +364,12 @@ void StreamSocket::FlushSendQ(SendQueue& sq)
 				error = SocketEngine::LastError();
 			}
 		}
+
+#ifdef TCP_CORK
+		if (corked)
+			SocketEngine::SetOption<int>(this, IPPROTO_TCP, TCP_CORK, 0);
+#endif
+
 		if (!error.empty())
 		{
 			// error - kill all events
@@ -351,12 +381,12 @@ void StreamSocket::FlushSendQ(SendQueue& sq)
 		}
 }
 
-void StreamSocket::WriteData(const std::string& data)
+void StreamSocket::WriteData(const SendQueue::Element& data)
 {
 	if (!HasFd())
 	{
 		ServerInstance->Logs.Debug("SOCKET", "Attempt to write data to dead socket: {}",
-			data);
+			data.view());
 		return;
 	}
 
@@ -451,7 +481,7 @@ void StreamSocket::OnEventHandlerError(int errornum)
 
 void StreamSocket::OnEventHandlerRead()
 {
-	if (!error.empty())
+	if (!error.empty() || netlink)
 		return;
 
 	try
@@ -472,6 +502,14 @@ void StreamSocket::OnEventHandlerWrite()
 	if (!error.empty())
 		return;
 
+	if (SocketEngine::IsDeferringWrites())
+	{
+		// Anything else which is queued for this socket while the remaining
+		// events are dispatched will be sent along with the current sendq.
+		SocketEngine::ChangeEventMask(this, FD_ADD_TRIAL_WRITE);
+		return;
+	}
+
 	DoWrite();
 	CheckError(I_ERR_OTHER);
 }
@@ -508,6 +546,14 @@ IOHook* StreamSocket::GetLastHook() const
 
 void StreamSocket::AddIOHook(IOHook* newhook)
 {
+	if (netlink)
+	{
+		// Hooks need to see the raw stream so take the socket back from its
+		// network thread and send any plaintext which is still queued first.
+		ServerInstance->NetThreads.Detach(this, true);
+		DoWrite();
+	}
+
 	IOHook* curr = GetIOHook();
 	if (!curr)
 	{
@@ -530,6 +576,9 @@ void StreamSocket::AddIOHook(IOHook* newhook)
 size_t StreamSocket::GetSendQSize() const
 {
 	size_t ret = sendq.bytes();
+	if (netlink)
+		ret += ServerInstance->NetThreads.GetSendQSize(this);
+
 	IOHook* curr = GetIOHook();
 	while (curr)
 	{
@@ -29,67 +29,204 @@
 
 void Timer::SetInterval(unsigned long newinterval, bool restart)
 {
-	secs = newinterval;
+	SetIntervalMillis(static_cast<uint64_t>(newinterval) * 1000, restart);
+}
+
+void Timer::SetIntervalMillis(uint64_t newinterval, bool restart)
+{
+	msecs = newinterval;
 	if (!restart)
 		return;
 
 	ServerInstance->Timers.DelTimer(this);
-	SetTrigger(ServerInstance->Time() + newinterval);
 	ServerInstance->Timers.AddTimer(this);
 }
 
 Timer::Timer(unsigned long secs_from_now, bool repeating)
-	: secs(secs_from_now)
+	: msecs(static_cast<uint64_t>(secs_from_now) * 1000)
 	, repeat(repeating)
 {
 }
 
 Timer::~Timer()
 {
-	if (GetTrigger())
+	if (slot)
 		ServerInstance->Timers.DelTimer(this);
 }
 
-void TimerManager::TickTimers()
+namespace
 {
-	const time_t now = ServerInstance->Time();
-	for (TimerMap::iterator i = Timers.begin(); i != Timers.end(); )
+	// If the clock jumps forward by more than this many milliseconds then the timers are
+	// rebuilt rather than stepping through every millisecond that was skipped.
+	constexpr uint64_t MAX_SKIP = UINT64_C(1) << 20;
+}
+
+uint64_t TimerManager::Now()
+{
+	return static_cast<uint64_t>(ServerInstance->Time()) * 1000 + static_cast<uint64_t>(ServerInstance->Time_ns()) / 1000000;
+}
+
+void TimerManager::Schedule(Timer* t, bool cascading)
+{
+	// Timers which are already due go in the next slot that will be ticked (or the current one
+	// if it is about to be ticked) and timers which are further away than the wheel can cover go
+	// in the last slot and are rescheduled when it is cascaded.
+	const uint64_t earliest = cascading ? current : current + 1;
+	const uint64_t delta = std::min(std::max(t->expiry, earliest) - current, MAX_DELTA - 1);
+	const uint64_t target = current + delta;
+
+	size_t idx;
+	if (delta < ROOT_SIZE)
+		idx = target & ROOT_MASK;
+	else
 	{
-		Timer* t = i->second;
-		if (t->GetTrigger() > now)
-			break;
+		unsigned int level = 1;
+		while (delta >= (UINT64_C(1) << (ROOT_BITS + LEVEL_BITS * level)))
+			level++;
+		idx = ROOT_SIZE + (level - 1) * LEVEL_SIZE + ((target >> (ROOT_BITS + LEVEL_BITS * (level - 1))) & LEVEL_MASK);
+	}
 
-		Timers.erase(i++);
+	t->slot = &slots[idx];
+	t->slot->push_back(t);
+}
 
-		if (!t->Tick())
-			continue;
+void TimerManager::Cascade(unsigned int level, uint64_t tick)
+{
+	TimerList& list = slots[ROOT_SIZE + (level - 1) * LEVEL_SIZE + ((tick >> (ROOT_BITS + LEVEL_BITS * (level - 1))) & LEVEL_MASK)];
+	while (!list.empty())
+	{
+		Timer* t = list.front();
+		list.pop_front();
+		Schedule(t, true);
+	}
+}
 
-		if (t->GetRepeat())
+void TimerManager::Rebuild(uint64_t now)
+{
+	std::vector<Timer*> timers;
+	timers.reserve(count);
+	for (auto& list : slots)
+	{
+		while (!list.empty())
 		{
-			t->SetTrigger(now + t->GetInterval());
-			AddTimer(t);
+			timers.push_back(list.front());
+			list.pop_front();
 		}
 	}
+
+	// Reinsert in trigger order so that any overdue timers tick in the right order.
+	std::stable_sort(timers.begin(), timers.end(), [](const Timer* lhs, const Timer* rhs) {
+		return lhs->expiry < rhs->expiry;
+	});
+
+	current = now - 1;
+	for (auto* t : timers)
+		Schedule(t);
 }
 
-void TimerManager::DelTimer(Timer* t)
+void TimerManager::TickTimers()
 {
-	std::pair<TimerMap::iterator, TimerMap::iterator> itpair = Timers.equal_range(t->GetTrigger());
+	const uint64_t now = Now();
+	if (!current)
+		current = now;
+	else if (now < current || now - current > MAX_SKIP)
+		Rebuild(now);
 
-	for (TimerMap::iterator i = itpair.first; i != itpair.second; ++i)
+	while (current < now)
 	{
-		if (i->second == t)
+		if (!count)
 		{
-			t->SetTrigger(0);
-			Timers.erase(i);
+			// Nothing to tick so skip straight to the current time.
+			current = now;
 			break;
 		}
+
+		const uint64_t tick = ++current;
+		if (!(tick & ROOT_MASK))
+		{
+			// The first level has turned so move the timers for the next turn down from the
+			// levels above it.
+			for (unsigned int level = 1; level <= LEVELS; ++level)
+			{
+				Cascade(level, tick);
+				if ((tick >> (ROOT_BITS + LEVEL_BITS * (level - 1))) & LEVEL_MASK)
+					break;
+			}
+		}
+
+		TimerList& list = slots[tick & ROOT_MASK];
+		while (!list.empty())
+		{
+			Timer* t = list.front();
+			list.pop_front();
+			t->slot = nullptr;
+			t->SetTrigger(0);
+			count--;
+
+			if (!t->Tick())
+				continue;
+
+			// The timer may have been rescheduled by Tick().
+			if (t->GetRepeat() && !t->slot)
+				AddTimer(t);
+		}
 	}
 }
 
+void TimerManager::DelTimer(Timer* t)
+{
+	if (!t->slot)
+		return;
+
+	t->slot->erase(t);
+	t->slot = nullptr;
+	t->SetTrigger(0);
+	count--;
+}
+
 void TimerManager::AddTimer(Timer* t)
 {
-	time_t trigger = ServerInstance->Time() + t->GetInterval();
-	t->SetTrigger(trigger);
-	Timers.emplace(trigger, t);
+	DelTimer(t);
+
+	const uint64_t now = Now();
+	if (!current)
+		current = now;
+
+	t->expiry = now + t->GetIntervalMillis();
+	t->SetTrigger(static_cast<time_t>(t->expiry / 1000));
+	Schedule(t);
+	count++;
+}
+
+int TimerManager::GetWaitTime(int maxwait) const
+{
+	if (!count)
+		return maxwait;
+
+	const uint64_t now = Now();
+	const uint64_t limit = now + maxwait;
+
+	// The first level only holds timers which trigger within its next turn.
+	uint64_t wake = limit;
+	for (uint64_t tick = current + 1; tick <= std::min(limit, current + ROOT_SIZE); ++tick)
+	{
+		if (!slots[tick & ROOT_MASK].empty())
+		{
+			wake = tick;
+			break;
+		}
+	}
+
+	// Timers in the higher levels are moved down at the start of each turn of the first level.
+	for (uint64_t tick = (current | ROOT_MASK) + 1; tick < wake; tick += ROOT_SIZE)
+	{
+		const uint64_t idx = (tick >> ROOT_BITS) & LEVEL_MASK;
+		if (!idx || !slots[ROOT_SIZE + idx].empty())
+		{
+			wake = tick;
+			break;
+		}
+	}
+
+	return wake <= now ? 0 : static_cast<int>(wake - now);
 }
@@ -235,6 +235,10 @@ void UserManager::AddUser(int socket, ListenSocket* via, const irc::sockets::soc
 	FOREACH_MOD(OnChangeRemoteAddress, (New));
 	if (!New->quitting)
 		FOREACH_MOD(OnUserPostInit, (New));
+
+	// Plaintext connections can have their I/O performed by a network thread.
+	if (!New->quitting && !eh->GetIOHook())
+		ServerInstance->NetThreads.Attach(eh);
 }
 
 void UserManager::QuitUser(User* user, const std::string& quitmessage, const std::string* operquitmessage)
@@ -359,44 +363,46 @@ const UserManager::CloneCounts& UserManager::GetCloneCounts(User* user) const
 		return zeroclonecounts;
 }
 
-/**
- * This function is called once a second from the mainloop.
- * It is intended to do background checking on all the users, e.g. do
- * ping checks, connection timeouts, etc.
- */
-void UserManager::DoBackgroundUserStuff()
+void UserManager::DoBackgroundUserStuff(LocalUser* curr)
 {
-	for (LocalList::iterator i = local_users.begin(); i != local_users.end(); )
-	{
-		// It's possible that we quit the user below due to ping timeout etc. and QuitUser() removes it from the list
-		LocalUser* curr = *i;
-		++i;
+	if (curr->quitting)
+		return;
 
-		if (curr->CommandFloodPenalty || curr->eh.GetSendQSize())
-		{
-			unsigned long rate = curr->GetClass()->commandrate;
-			if (curr->CommandFloodPenalty > rate)
-				curr->CommandFloodPenalty -= rate;
-			else
-				curr->CommandFloodPenalty = 0;
-			curr->eh.OnDataReady();
-		}
+	// Process any lines which were held back by the penalty or sendq of the user. The penalty
+	// decays continuously so this is done as soon as the next line is allowed.
+	if (curr->eh.HasPendingData())
+		curr->eh.OnDataReady();
 
-		switch (curr->connected)
-		{
-			case User::CONN_FULL:
-				CheckPingTimeout(curr);
-				break;
+	switch (curr->connected)
+	{
+		case User::CONN_FULL:
+			CheckPingTimeout(curr);
+			break;
 
-			case User::CONN_NICKUSER:
-				CheckModulesReady(curr);
-				break;
+		case User::CONN_NICKUSER:
+			CheckModulesReady(curr);
+			break;
 
-			default:
-				CheckConnectionTimeout(curr);
-				break;
-		}
+		default:
+			CheckConnectionTimeout(curr);
+			break;
 	}
+
+	if (curr->quitting)
+		return;
+
+	// Work out when this user next needs to be looked at. Users who are waiting for modules to
+	// let them connect are checked every second. Throttled users are scheduled by OnDataReady.
+	const time_t now = ServerInstance->Time();
+	time_t next;
+	if (curr->connected == User::CONN_NICKUSER)
+		next = now + 1;
+	else if (curr->IsFullyConnected())
+		next = curr->nextping;
+	else
+		next = curr->signon + curr->GetClass()->connection_timeout + 1;
+
+	curr->ScheduleHousekeeping(std::max(next, now + 1));
 }
 
 uint64_t UserManager::NextAlreadySentId()
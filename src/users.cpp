@@ -177,6 +177,7 @@ const std::string& User::GetRealMask()
 
 LocalUser::LocalUser(int myfd, const irc::sockets::sockaddrs& clientsa, const irc::sockets::sockaddrs& serversa)
 	: User(ServerInstance->UIDGen.GetUID(), ServerInstance->FakeClient->server, User::TYPE_LOCAL)
+	, housekeeping(this)
 	, eh(this)
 	, server_sa(serversa)
 	, quitting_sendq(false)
@@ -235,64 +236,92 @@ void UserIOHandler::OnDataReady()
 	if (!user->HasPrivPermission("users/flood/no-fakelag"))
 		penaltymax = user->GetClass()->penaltythreshold * 1000;
 
+	// Reduce the penalty of the user by however much has decayed since we last did so. If the
+	// elapsed time is too short to decay anything we leave lastdecay alone so it accumulates.
+	const uint64_t now = TimerManager::Now();
+	const unsigned long rate = user->GetClass()->commandrate;
+	if (!user->CommandFloodPenalty)
+		lastdecay = now;
+	else if (now > lastdecay)
+	{
+		const uint64_t decay = (now - lastdecay) * rate / 1000;
+		if (decay)
+		{
+			user->CommandFloodPenalty -= static_cast<unsigned int>(std::min<uint64_t>(decay, user->CommandFloodPenalty));
+			lastdecay = now;
+		}
+	}
+
 	// The cleaned message sent by the user or empty if not found yet.
 	std::string line;
 
-	// The position of the most \n character or npos if not found yet.
-	std::string::size_type eolpos;
-
-	// The position within the recvq of the current character.
-	std::string::size_type qpos;
+	// The position within the recvq of the start of the current line. Lines are parsed in place
+	// and the consumed data is only removed from the recvq once we have finished parsing.
+	size_t linestart = 0;
 
 	while (user->CommandFloodPenalty < penaltymax && GetSendQSize() < sendqmax)
 	{
 		// Check the newly received data for an EOL.
-		eolpos = recvq.find('\n', checked_until);
-		if (eolpos == std::string::npos)
+		const char* eol = static_cast<const char*>(memchr(recvq.data() + checked_until, '\n', recvq.length() - checked_until));
+		if (!eol)
 		{
 			checked_until = recvq.length();
-			return;
+			break;
 		}
 
-		// We've found a line! Clean it up and move it to the line buffer.
-		line.reserve(eolpos);
-		for (qpos = 0; qpos < eolpos; ++qpos)
+		// We've found a line! Copy it to the line buffer and then clean it up in a single pass by
+		// replacing any null characters with a space and removing any carriage returns.
+		const size_t eolpos = eol - recvq.data();
+		line.assign(recvq, linestart, eolpos - linestart);
+		auto lineend = line.begin();
+		for (const auto chr : line)
 		{
-			char c = recvq[qpos];
-			switch (c)
-			{
-				case '\0':
-					c = ' ';
-					break;
-				case '\r':
-					continue;
-			}
-
-			line.push_back(c);
+			if (chr == '\r')
+				continue;
+			*lineend++ = chr ? chr : ' ';
 		}
-
-		// just found a newline. Terminate the string, and pull it out of recvq
-		recvq.erase(0, eolpos + 1);
-		checked_until = 0;
+		line.erase(lineend, line.end());
 
 		// TODO should this be moved to when it was inserted in recvq?
-		ServerInstance->Stats.Recv += qpos;
-		user->bytes_in += qpos;
+		ServerInstance->Stats.Recv += eolpos - linestart;
+		user->bytes_in += eolpos - linestart;
 		user->cmds_in++;
 
+		linestart = checked_until = eolpos + 1;
 		ServerInstance->Parser.ProcessBuffer(user, line);
 		if (user->quitting)
 			return;
-
-		// clear() does not reclaim memory associated with the string, so our .reserve() call is safe
-		line.clear();
 	}
 
+	// Remove the lines we have processed from the recvq.
+	if (linestart == recvq.length())
+		recvq.clear();
+	else if (linestart)
+		recvq.erase(0, linestart);
+	checked_until -= linestart;
+
 	if (user->CommandFloodPenalty >= penaltymax && !user->GetClass()->fakelag)
+	{
 		ServerInstance->Users.QuitUser(user, "Excess Flood");
+		return;
+	}
+
+	if (!HasPendingData())
+		return;
+
+	// The user has lines we could not process yet. If they were held back by the penalty of the
+	// user then come back to them as soon as it has decayed enough for the next line to be
+	// allowed. Otherwise, they were held back by the sendq so check again in a second.
+	if (user->CommandFloodPenalty >= penaltymax && rate)
+	{
+		const uint64_t excess = user->CommandFloodPenalty - penaltymax + 1;
+		user->ScheduleHousekeepingMillis(lastdecay + (excess * 1000 + rate - 1) / rate);
+	}
+	else
+		user->ScheduleHousekeepingMillis(now + 1000);
 }
 
-void UserIOHandler::AddWriteBuf(const std::string& data)
+void UserIOHandler::AddWriteBuf(const SendQueue::Element& data)
 {
 	if (user->quitting_sendq)
 		return;
@@ -353,6 +382,25 @@ Cullable::Result LocalUser::Cull()
 	return User::Cull();
 }
 
+bool LocalUser::HousekeepingTimer::Tick()
+{
+	ServerInstance->Users.DoBackgroundUserStuff(user);
+	return true;
+}
+
+void LocalUser::ScheduleHousekeepingMillis(uint64_t when)
+{
+	if (quitting)
+		return;
+
+	const uint64_t trigger = housekeeping.GetTriggerMillis();
+	if (trigger && trigger <= when)
+		return; // Already due before then.
+
+	const uint64_t now = TimerManager::Now();
+	housekeeping.SetIntervalMillis(when > now ? when - now : 0);
+}
+
 Cullable::Result FakeUser::Cull()
 {
 	// Fake users don't quit, they just get culled.
@@ -496,6 +544,7 @@ void LocalUser::FullConnect()
 	ServerInstance->BanCache.AddHit(this->GetAddress(), "", "");
 	// reset the flood penalty (which could have been raised due to things like auto +x)
 	CommandFloodPenalty = 0;
+	ScheduleHousekeeping(nextping);
 }
 
 void User::InvalidateCache()
@@ -700,6 +749,7 @@ void LocalUser::ChangeConnectClass(const std::shared_ptr<ConnectClass>& klass, b
 	// Update the core user data that depends on connect class.
 	nextping = ServerInstance->Time() + klass->pingtime;
 	uniqueusername = klass->uniqueusername;
+	ScheduleHousekeeping(IsFullyConnected() ? nextping : signon + klass->connection_timeout + 1);
 
 	// Let modules know the class has been changed.
 	FOREACH_MOD(OnPostChangeConnectClass, (this, force));
@@ -715,11 +765,11 @@ void LocalUser::Write(const ClientProtocol::SerializedMessage& text)
 		if (text.empty())
 			return;
 
-		std::string::size_type nlpos = text.find_first_of("\r\n", 0, 2);
-		if (nlpos == std::string::npos)
+		std::string_view::size_type nlpos = text.view().find_first_of("\r\n", 0, 2);
+		if (nlpos == std::string_view::npos)
 			nlpos = text.length();
 
-		ServerInstance->Logs.RawIO("USEROUTPUT", "C[{}] O {}", uuid, std::string_view(text.c_str(), nlpos));
+		ServerInstance->Logs.RawIO("USEROUTPUT", "C[{}] O {}", uuid, std::string_view(text.data(), nlpos));
 	}
 
 	eh.AddWriteBuf(text);
@@ -859,11 +909,11 @@ uint64_t User::ForEachNeighbor(ForEachNeighborHandler& handler, bool include_sel
 	// Now consider the real neighbors
 	for (const auto* memb : include_chans)
 	{
-		for (const auto& [user, _] : memb->chan->GetUsers())
+		for (const auto* chanmemb : memb->chan->GetLocalUsers())
 		{
-			LocalUser* curr = IS_LOCAL(user);
+			LocalUser* curr = static_cast<LocalUser*>(chanmemb->user);
 			// User not yet visited?
-			if ((curr) && (curr->already_sent != newid))
+			if (curr->already_sent != newid)
 			{
 				// Mark as visited and execute function
 				curr->already_sent = newid;
@@ -1051,6 +1101,7 @@ void User::WriteNotice(const std::string& text)
 ConnectClass::ConnectClass(const std::shared_ptr<ConfigTag>& tag, Type t, const std::vector<std::string>& masks)
 	: config(tag)
 	, hosts(masks)
+	, compiledhosts(masks.begin(), masks.end())
 	, name("unnamed")
 	, type(t)
 	, fakelag(true)
@@ -1066,6 +1117,7 @@ ConnectClass::ConnectClass(const std::shared_ptr<ConfigTag>& tag, Type t, const
 	name = "unnamed";
 	type = t;
 	hosts = masks;
+	compiledhosts.assign(masks.begin(), masks.end());
 
 	// Connect classes can inherit from each other but this is problematic for modules which can't use
 	// ConnectClass::Update so we build a hybrid tag containing all of the values set on this class as
@@ -1133,6 +1185,7 @@ void ConnectClass::Update(const std::shared_ptr<ConnectClass>& src)
 	fakelag = src->fakelag;
 	hardsendqmax = src->hardsendqmax;
 	hosts = src->hosts;
+	compiledhosts = src->compiledhosts;
 	limit = src->limit;
 	maxchans = src->maxchans;
 	maxconnwarn = src->maxconnwarn;
@@ -124,3 +124,128 @@ bool InspIRCd::MatchMask(const std::string& masks, const std::string& hostname,
 	}
 	return false;
 }
+
+CompiledMask::CompiledMask(const std::string& pattern, const unsigned char* casemap)
+	: mask(pattern)
+	, map(casemap)
+{
+	// Split the pattern into the runs between each '*'. The first and last runs are always
+	// stored (even if empty) so they can be anchored to the start and end of the subject but
+	// the empty runs between consecutive '*' are dropped.
+	for (size_t start = 0; ; )
+	{
+		const size_t star = mask.find('*', start);
+		const size_t end = (star == std::string::npos) ? mask.length() : star;
+		if (end > start || segments.empty() || star == std::string::npos)
+		{
+			const bool wild = std::find(mask.begin() + start, mask.begin() + end, '?') != mask.begin() + end;
+			segments.push_back({ start, end - start, wild });
+			minlength += end - start;
+		}
+
+		if (star == std::string::npos)
+			break;
+
+		hasstar = true;
+		start = star + 1;
+	}
+
+	// irc::sockets::MatchCIDR can only succeed if the host part of the mask is an IP address
+	// or one of the wildcard addresses accepted by sockaddrs::from_ip.
+	const std::string::size_type at = mask.rfind('@');
+	const std::string host = (at == std::string::npos) ? mask : mask.substr(at + 1);
+	maybecidr = host.empty() || host == "*" || host.find_first_not_of("0123456789ABCDEFabcdef./:") == std::string::npos;
+}
+
+const std::string& CompiledMask::GetFolded(const unsigned char* curmap) const
+{
+	// The national case map can be changed at runtime so the folded pattern is rebuilt lazily.
+	if (foldmap != curmap)
+	{
+		folded.resize(mask.length());
+		for (size_t idx = 0; idx < mask.length(); ++idx)
+			folded[idx] = static_cast<char>(curmap[static_cast<unsigned char>(mask[idx])]);
+		foldmap = curmap;
+	}
+	return folded;
+}
+
+bool CompiledMask::Match(std::string_view str) const
+{
+	if (str.length() < minlength || (!hasstar && str.length() != minlength))
+		return false;
+
+	const unsigned char* curmap = map ? map : national_case_insensitive_map;
+	const std::string& fmask = GetFolded(curmap);
+
+	// Fold the subject once so that the literal runs can be compared bytewise.
+	char stackbuf[512];
+	std::string heapbuf;
+	char* subject = stackbuf;
+	if (str.length() > sizeof(stackbuf))
+	{
+		heapbuf.resize(str.length());
+		subject = heapbuf.data();
+	}
+	for (size_t idx = 0; idx < str.length(); ++idx)
+		subject[idx] = static_cast<char>(curmap[static_cast<unsigned char>(str[idx])]);
+
+	const auto compare = [&](const Segment& segment, size_t pos)
+	{
+		if (!segment.wild)
+			return !memcmp(subject + pos, fmask.data() + segment.offset, segment.length);
+
+		for (size_t idx = 0; idx < segment.length; ++idx)
+		{
+			const size_t midx = segment.offset + idx;
+			if (mask[midx] != '?' && fmask[midx] != subject[pos + idx])
+				return false;
+		}
+		return true;
+	};
+
+	if (!hasstar)
+		return compare(segments.front(), 0);
+
+	const Segment& prefix = segments.front();
+	const Segment& suffix = segments.back();
+	if (!compare(prefix, 0) || !compare(suffix, str.length() - suffix.length))
+		return false;
+
+	// The runs between the prefix and suffix are matched greedily from the left. Taking the
+	// leftmost occurrence of each run never prevents a later run from matching.
+	size_t pos = prefix.length;
+	const size_t end = str.length() - suffix.length;
+	for (size_t idx = 1; idx + 1 < segments.size(); ++idx)
+	{
+		const Segment& segment = segments[idx];
+		if (!segment.wild)
+		{
+			const std::string_view haystack(subject + pos, end - pos);
+			const size_t found = haystack.find(std::string_view(fmask.data() + segment.offset, segment.length));
+			if (found == std::string_view::npos)
+				return false;
+
+			pos += found + segment.length;
+			continue;
+		}
+
+		while (pos + segment.length <= end && !compare(segment, pos))
+			pos++;
+
+		if (pos + segment.length > end)
+			return false;
+
+		pos += segment.length;
+	}
+	return true;
+}
+
+bool CompiledMask::MatchCIDR(const std::string& str) const
+{
+	if (maybecidr && irc::sockets::MatchCIDR(str, mask, true))
+		return true;
+
+	// Fall back to regular match
+	return Match(str);
+}
@@ -129,6 +129,19 @@ public:
 	}
 };
 
+/** Applies the pending X-lines at the end of the current main loop iteration.
+ */
+class ApplyLinesAction final
+	: public ActionBase
+{
+public:
+	void Call() override
+	{
+		ServerInstance->XLines->ApplyLines();
+		ServerInstance->GlobalCulls.AddItem(this);
+	}
+};
+
 /*
  * This is now version 3 of the XLine subsystem, let's see if we can get it as nice and
  * efficient as we can this time so we can close this file and never ever touch it again ..
@@ -161,6 +174,285 @@ public:
  *  bans. :)
  */
 
+namespace
+{
+	// The characters which every case map folds in the same way. Host masks which contain
+	// anything else are not indexed as the index always folds with the ASCII case map.
+	const char* const INDEXABLE_CHARS = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz-./:_";
+
+	std::string FoldHost(const std::string& host)
+	{
+		std::string folded(host);
+		for (auto& chr : folded)
+			chr = static_cast<char>(ascii_case_insensitive_map[static_cast<unsigned char>(chr)]);
+		return folded;
+	}
+
+	// Parses a host mask which irc::sockets::MatchCIDR will treat as an IP address or CIDR range.
+	bool ParseCIDR(const std::string& host, irc::sockets::cidr_mask& mask)
+	{
+		const std::string::size_type per_pos = host.rfind('/');
+		if (per_pos != std::string::npos && (per_pos == host.length() - 1 || host.find_first_not_of("0123456789", per_pos + 1) != std::string::npos))
+			return false;
+
+		irc::sockets::sockaddrs sa;
+		if (!sa.from_ip(host.substr(0, per_pos)) || (sa.family() != AF_INET && sa.family() != AF_INET6))
+			return false;
+
+		mask = irc::sockets::cidr_mask(host);
+		return true;
+	}
+
+	bool GetBit(const unsigned char* bits, unsigned char bit)
+	{
+		return bits[bit / 8] & (0x80 >> (bit % 8));
+	}
+
+	unsigned char CommonPrefix(const unsigned char* first, const unsigned char* second, unsigned char length)
+	{
+		unsigned char bit = 0;
+		while (bit < length && GetBit(first, bit) == GetBit(second, bit))
+			bit++;
+		return bit;
+	}
+}
+
+struct XLineIndex::CIDRNode final
+{
+	/** The bits of the range this node represents. Bits past the length are zero. */
+	unsigned char bits[16];
+
+	/** The length of the range this node represents. */
+	unsigned char length;
+
+	/** The lines which match exactly this range. */
+	std::vector<XLine*> lines;
+
+	/** The nodes for the longer ranges within this one keyed by the next bit. */
+	std::unique_ptr<CIDRNode> children[2];
+
+	CIDRNode(const unsigned char* b, unsigned char l)
+		: length(l)
+	{
+		memset(bits, 0, sizeof(bits));
+		for (unsigned char bit = 0; bit < length; ++bit)
+		{
+			if (GetBit(b, bit))
+				bits[bit / 8] |= (0x80 >> (bit % 8));
+		}
+	}
+
+	static void Insert(std::unique_ptr<CIDRNode>& node, const irc::sockets::cidr_mask& mask, XLine* line)
+	{
+		if (!node)
+		{
+			node = std::make_unique<CIDRNode>(mask.bits, mask.length);
+			node->lines.push_back(line);
+			return;
+		}
+
+		const unsigned char common = CommonPrefix(node->bits, mask.bits, std::min(node->length, mask.length));
+		if (common == node->length)
+		{
+			if (mask.length == node->length)
+				node->lines.push_back(line);
+			else
+				Insert(node->children[GetBit(mask.bits, node->length)], mask, line);
+			return;
+		}
+
+		// The range diverges from this node part way through so split it at the common prefix.
+		auto parent = std::make_unique<CIDRNode>(mask.bits, common);
+		parent->children[GetBit(node->bits, common)] = std::move(node);
+		node = std::move(parent);
+		if (mask.length == common)
+			node->lines.push_back(line);
+		else
+			Insert(node->children[GetBit(mask.bits, common)], mask, line);
+	}
+
+	static void Remove(std::unique_ptr<CIDRNode>& node, const irc::sockets::cidr_mask& mask, XLine* line)
+	{
+		if (!node || node->length > mask.length || CommonPrefix(node->bits, mask.bits, node->length) != node->length)
+			return;
+
+		if (node->length == mask.length)
+			stdalgo::erase(node->lines, line);
+		else
+			Remove(node->children[GetBit(mask.bits, node->length)], mask, line);
+
+		// Collapse nodes which no longer hold any lines.
+		if (!node->lines.empty() || (node->children[0] && node->children[1]))
+			return;
+
+		if (node->children[0])
+			node = std::move(node->children[0]);
+		else if (node->children[1])
+			node = std::move(node->children[1]);
+		else
+			node.reset();
+	}
+
+	static void Find(const CIDRNode* node, const irc::sockets::cidr_mask& addr, std::vector<XLine*>& candidates)
+	{
+		for (; node; node = node->children[GetBit(addr.bits, node->length)].get())
+		{
+			if (CommonPrefix(node->bits, addr.bits, node->length) != node->length)
+				return;
+
+			candidates.insert(candidates.end(), node->lines.begin(), node->lines.end());
+			if (node->length >= addr.length)
+				return;
+		}
+	}
+};
+
+struct XLineIndex::SuffixNode final
+{
+	/** The lines which match hosts ending in the suffix this node represents. */
+	std::vector<XLine*> lines;
+
+	/** The nodes for the longer suffixes keyed by the preceding character. */
+	std::map<char, std::unique_ptr<SuffixNode>> children;
+};
+
+XLineIndex::XLineIndex() = default;
+
+XLineIndex::~XLineIndex() = default;
+
+void XLineIndex::Add(XLine* line)
+{
+	const std::string* host = line->GetHostMask();
+	if (!host || host->empty())
+	{
+		unindexed.push_back(line);
+		return;
+	}
+
+	const std::string::size_type badchar = host->find_first_not_of(INDEXABLE_CHARS);
+	if (badchar == std::string::npos)
+	{
+		// Without wildcards the mask can only match a host exactly or as an IP address.
+		irc::sockets::cidr_mask mask;
+		if (ParseCIDR(*host, mask))
+			CIDRNode::Insert(mask.type == AF_INET ? cidr4 : cidr6, mask, line);
+		exact[FoldHost(*host)].push_back(line);
+		return;
+	}
+
+	if (badchar == 0 && (*host)[0] == '*' && host->length() > 1 && host->find_first_not_of(INDEXABLE_CHARS, 1) == std::string::npos)
+	{
+		if (!suffixes)
+			suffixes = std::make_unique<SuffixNode>();
+
+		SuffixNode* node = suffixes.get();
+		const std::string suffix = FoldHost(host->substr(1));
+		for (auto chr = suffix.rbegin(); chr != suffix.rend(); ++chr)
+		{
+			auto& child = node->children[*chr];
+			if (!child)
+				child = std::make_unique<SuffixNode>();
+			node = child.get();
+		}
+		node->lines.push_back(line);
+		return;
+	}
+
+	unindexed.push_back(line);
+}
+
+void XLineIndex::Remove(XLine* line)
+{
+	const std::string* host = line->GetHostMask();
+	if (!host || host->empty())
+	{
+		stdalgo::erase(unindexed, line);
+		return;
+	}
+
+	const std::string::size_type badchar = host->find_first_not_of(INDEXABLE_CHARS);
+	if (badchar == std::string::npos)
+	{
+		irc::sockets::cidr_mask mask;
+		if (ParseCIDR(*host, mask))
+			CIDRNode::Remove(mask.type == AF_INET ? cidr4 : cidr6, mask, line);
+
+		auto it = exact.find(FoldHost(*host));
+		if (it != exact.end())
+		{
+			stdalgo::erase(it->second, line);
+			if (it->second.empty())
+				exact.erase(it);
+		}
+		return;
+	}
+
+	if (badchar == 0 && (*host)[0] == '*' && host->length() > 1 && host->find_first_not_of(INDEXABLE_CHARS, 1) == std::string::npos)
+	{
+		// Walk down to the node for this suffix remembering the path so empty nodes can be pruned.
+		std::vector<std::pair<SuffixNode*, char>> path;
+		SuffixNode* node = suffixes.get();
+		const std::string suffix = FoldHost(host->substr(1));
+		for (auto chr = suffix.rbegin(); node && chr != suffix.rend(); ++chr)
+		{
+			auto it = node->children.find(*chr);
+			path.emplace_back(node, *chr);
+			node = (it == node->children.end()) ? nullptr : it->second.get();
+		}
+
+		if (!node)
+			return;
+
+		stdalgo::erase(node->lines, line);
+		for (auto step = path.rbegin(); step != path.rend(); ++step)
+		{
+			auto it = step->first->children.find(step->second);
+			if (!it->second->lines.empty() || !it->second->children.empty())
+				break;
+			step->first->children.erase(it);
+		}
+		return;
+	}
+
+	stdalgo::erase(unindexed, line);
+}
+
+void XLineIndex::FindCandidates(const std::string& host, std::vector<XLine*>& candidates) const
+{
+	irc::sockets::sockaddrs sa;
+	if ((cidr4 || cidr6) && sa.from_ip(host))
+	{
+		const irc::sockets::cidr_mask addr(sa, 128);
+		CIDRNode::Find(addr.type == AF_INET ? cidr4.get() : cidr6.get(), addr, candidates);
+	}
+
+	const std::string folded = FoldHost(host);
+	auto it = exact.find(folded);
+	if (it != exact.end())
+		candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+
+	const SuffixNode* node = suffixes.get();
+	for (auto chr = folded.rbegin(); node && chr != folded.rend(); ++chr)
+	{
+		auto child = node->children.find(*chr);
+		node = (child == node->children.end()) ? nullptr : child->second.get();
+		if (node)
+			candidates.insert(candidates.end(), node->lines.begin(), node->lines.end());
+	}
+}
+
+void XLineIndex::GetCandidates(User* user, std::vector<XLine*>& candidates) const
+{
+	candidates.insert(candidates.end(), unindexed.begin(), unindexed.end());
+	FindCandidates(user->GetRealHost(), candidates);
+	if (user->GetAddress() != user->GetRealHost())
+		FindCandidates(user->GetAddress(), candidates);
+
+	// A line can be found through both the hostname and the IP address.
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+}
+
 bool XLine::Matches(User* u) const
 {
 	return false;
@@ -181,23 +473,22 @@ void XLineManager::CheckELines()
 	if (ELines.empty())
 		return;
 
+	// Only the E-lines which the index says may match a user need to be checked.
+	const XLineIndex& index = line_index["E"];
+	std::vector<XLine*> candidates;
 	for (auto* u :  ServerInstance->Users.GetLocalUsers())
 	{
 		u->exempt = false;
 
-		/* This uses safe iteration to ensure that if a line expires here, it doesn't trash the iterator */
-		LookupIter safei;
-
-		for (LookupIter i = ELines.begin(); i != ELines.end(); )
+		candidates.clear();
+		index.GetCandidates(u, candidates);
+		for (auto* e : candidates)
 		{
-			safei = i;
-			safei++;
-
-			XLine* e = i->second;
 			if ((!e->duration || ServerInstance->Time() < e->expiry) && e->Matches(u))
+			{
 				u->exempt = true;
-
-			i = safei;
+				break;
+			}
 		}
 	}
 }
@@ -325,6 +616,7 @@ bool XLineManager::AddLine(XLine* line, User* user)
 		pending_lines.push_back(line);
 
 	lookup_lines[line->type][line->Displayable()] = line;
+	line_index[line->type].Add(line);
 	line->OnAdd();
 
 	FOREACH_MOD(OnAddLine, (user, line));
@@ -358,6 +650,7 @@ bool XLineManager::DelLine(const std::string& hostmask, const std::string& type,
 	y->second->Unset();
 
 	stdalgo::erase(pending_lines, y->second);
+	line_index[type].Remove(y->second);
 
 	delete y->second;
 	x->second.erase(y);
@@ -379,29 +672,22 @@ XLine* XLineManager::MatchesLine(const std::string& type, User* user)
 	if (x == lookup_lines.end())
 		return nullptr;
 
-	const time_t current = ServerInstance->Time();
-
-	LookupIter safei;
+	// Only the lines which the index says may match need to be checked.
+	std::vector<XLine*> candidates;
+	line_index[type].GetCandidates(user, candidates);
 
-	for (LookupIter i = x->second.begin(); i != x->second.end(); )
+	const time_t current = ServerInstance->Time();
+	for (auto* line : candidates)
 	{
-		safei = i;
-		safei++;
-
-		if (i->second->duration && current > i->second->expiry)
+		if (line->duration && current > line->expiry)
 		{
 			/* Expire the line, proceed to next one */
-			ExpireLine(x, i);
-			i = safei;
+			ExpireLine(x, x->second.find(line->Displayable()));
 			continue;
 		}
 
-		if (i->second->Matches(user))
-		{
-			return i->second;
-		}
-
-		i = safei;
+		if (line->Matches(user))
+			return line;
 	}
 	return nullptr;
 }
@@ -457,6 +743,7 @@ void XLineManager::ExpireLine(ContainerIter container, LookupIter item, bool sil
 	 * -- Brain
 	 */
 	stdalgo::erase(pending_lines, item->second);
+	line_index[container->first].Remove(item->second);
 
 	delete item->second;
 	container->second.erase(item);
@@ -465,6 +752,21 @@ void XLineManager::ExpireLine(ContainerIter container, LookupIter item, bool sil
 // applies lines, removing clients and changing nicks etc as applicable
 void XLineManager::ApplyLines()
 {
+	applyqueued = false;
+	if (pending_lines.empty())
+		return;
+
+	// Index the pending lines so each user only has to be checked against the ones which may
+	// match them. The lines are still applied in the order they were added.
+	XLineIndex index;
+	std::unordered_map<XLine*, size_t> order;
+	for (auto* x : pending_lines)
+	{
+		index.Add(x);
+		order.emplace(x, order.size());
+	}
+
+	std::vector<XLine*> candidates;
 	const UserManager::LocalList& list = ServerInstance->Users.GetLocalUsers();
 	for (UserManager::LocalList::const_iterator j = list.begin(); j != list.end(); )
 	{
@@ -474,7 +776,13 @@ void XLineManager::ApplyLines()
 		if (u->exempt)
 			continue;
 
-		for (auto* x : pending_lines)
+		candidates.clear();
+		index.GetCandidates(u, candidates);
+		std::sort(candidates.begin(), candidates.end(), [&order](XLine* lhs, XLine* rhs) {
+			return order[lhs] < order[rhs];
+		});
+
+		for (auto* x : candidates)
 		{
 			if (x->Matches(u))
 			{
@@ -491,6 +799,15 @@ void XLineManager::ApplyLines()
 	pending_lines.clear();
 }
 
+void XLineManager::QueueApplyLines()
+{
+	if (applyqueued || pending_lines.empty())
+		return;
+
+	applyqueued = true;
+	ServerInstance->AtomicActions.AddAction(new ApplyLinesAction());
+}
+
 bool XLineManager::InvokeStats(const std::string& type, Stats::Context& context)
 {
 	ContainerIter citer = lookup_lines.find(type);
@@ -588,10 +905,9 @@ bool KLine::Matches(User* u) const
 	if (lu && lu->exempt)
 		return false;
 
-	if (InspIRCd::Match(u->GetRealUser(), this->usermask, ascii_case_insensitive_map))
+	if (compileduser.Match(u->GetRealUser()))
 	{
-		if (InspIRCd::MatchCIDR(u->GetRealHost(), this->hostmask, ascii_case_insensitive_map) ||
-			InspIRCd::MatchCIDR(u->GetAddress(), this->hostmask, ascii_case_insensitive_map))
+		if (compiledhost.MatchCIDR(u->GetRealHost()) || compiledhost.MatchCIDR(u->GetAddress()))
 		{
 			return true;
 		}
@@ -611,10 +927,9 @@ bool GLine::Matches(User* u) const
 	if (lu && lu->exempt)
 		return false;
 
-	if (InspIRCd::Match(u->GetRealUser(), this->usermask, ascii_case_insensitive_map))
+	if (compileduser.Match(u->GetRealUser()))
 	{
-		if (InspIRCd::MatchCIDR(u->GetRealHost(), this->hostmask, ascii_case_insensitive_map) ||
-			InspIRCd::MatchCIDR(u->GetAddress(), this->hostmask, ascii_case_insensitive_map))
+		if (compiledhost.MatchCIDR(u->GetRealHost()) || compiledhost.MatchCIDR(u->GetAddress()))
 		{
 			return true;
 		}
@@ -630,10 +945,9 @@ void GLine::Apply(User* u)
 
 bool ELine::Matches(User* u) const
 {
-	if (InspIRCd::Match(u->GetRealUser(), this->usermask, ascii_case_insensitive_map))
+	if (compileduser.Match(u->GetRealUser()))
 	{
-		if (InspIRCd::MatchCIDR(u->GetRealHost(), this->hostmask, ascii_case_insensitive_map) ||
-			InspIRCd::MatchCIDR(u->GetAddress(), this->hostmask, ascii_case_insensitive_map))
+		if (compiledhost.MatchCIDR(u->GetRealHost()) || compiledhost.MatchCIDR(u->GetAddress()))
 		{
 			return true;
 		}
@@ -658,7 +972,7 @@ void ZLine::Apply(User* u)
 
 bool QLine::Matches(User* u) const
 {
-	return InspIRCd::Match(u->nick, this->nick);
+	return compilednick.Match(u->nick);
 }
 
 void QLine::Apply(User* u)
@@ -675,7 +989,7 @@ bool ZLine::Matches(const std::string& str) const
 
 bool QLine::Matches(const std::string& str) const
 {
-	return InspIRCd::Match(str, this->nick);
+	return compilednick.Match(str);
 }
 
 bool ELine::Matches(const std::string& str) const
@@ -735,6 +1049,26 @@ const std::string& QLine::Displayable() const
 	return nick;
 }
 
+const std::string* ELine::GetHostMask() const
+{
+	return &hostmask;
+}
+
+const std::string* KLine::GetHostMask() const
+{
+	return &hostmask;
+}
+
+const std::string* GLine::GetHostMask() const
+{
+	return &hostmask;
+}
+
+const std::string* ZLine::GetHostMask() const
+{
+	return &ipaddr;
+}
+
 bool KLine::IsBurstable()
 {
 	return false;